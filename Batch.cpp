@@ -0,0 +1,342 @@
+//===- Batch.cpp ----------------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Batch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+using namespace ms_demangle;
+
+// Splits p[0, end) into lines terminated by '\n' and appends them to
+// lines. A trailing '\r' is removed from each line. Returns the end of
+// the last line, which is where an unterminated line starts.
+static size_t split_lines(char *p, size_t end, std::vector<String> &lines) {
+  size_t begin = 0;
+  while (char *q = (char *)memchr(p + begin, '\n', end - begin)) {
+    size_t len = q - (p + begin);
+    if (len > 0 && p[begin + len - 1] == '\r')
+      len--;
+    lines.push_back({p + begin, len});
+    begin = q - p + 1;
+  }
+  return begin;
+}
+
+bool LineReader::next(std::vector<String> &lines) {
+  lines.clear();
+  if (eof)
+    return false;
+
+  // Move a line that was not terminated in the previous block to the
+  // beginning of the buffer. Lines returned by the previous call are
+  // invalidated here.
+  if (carry)
+    memmove(buf.data(), buf.data() + carry_pos, carry);
+  if (buf.size() < carry + block_size + 1)
+    buf.resize(carry + block_size + 1);
+
+  size_t n = fread(buf.data() + carry, 1, block_size, in);
+  size_t end = carry + n;
+  if (n == 0) {
+    eof = true;
+    if (end == 0)
+      return false;
+    // The last line of the input is not terminated by '\n'.
+    buf[end++] = '\n';
+  }
+
+  carry_pos = split_lines(buf.data(), end, lines);
+  carry = end - carry_pos;
+  return true;
+}
+
+// Demangles sym and returns the result. If sym cannot be demangled,
+// returns sym itself.
+static String demangle_one(Demangler &demangler, String sym,
+                           ResultCache *cache) {
+  demangler.reset(sym);
+  demangler.parse();
+  String s = demangler.error ? sym : demangler.view();
+
+  // view() fails if the result is too long.
+  if (demangler.error)
+    s = sym;
+  if (cache)
+    cache->insert(sym, s);
+  return s;
+}
+
+void ms_demangle::demangle_lines(Demangler &demangler, const String *syms,
+                                 size_t n, std::string &out,
+                                 ResultCache *cache) {
+  for (size_t i = 0; i < n; ++i) {
+    if (!cache || !cache->lookup(syms[i], out)) {
+      String s = demangle_one(demangler, syms[i], cache);
+      out.append(s.p, s.len);
+    }
+    out.push_back('\n');
+  }
+}
+
+// The number of symbols that a thread takes at once. Blocks are small
+// enough to balance load between threads and large enough to make the
+// cost of synchronization negligible.
+static constexpr size_t block_size = 4096;
+
+BatchDemangler::BatchDemangler(const Options &opts) : opts(opts) {
+  this->opts.threads = std::max(1u, opts.threads);
+  for (unsigned i = 0; i < this->opts.threads; ++i) {
+    workers.emplace_back(new Worker);
+    workers[i]->demangler.set_limits(opts.limits);
+    workers[i]->demangler.set_flags(opts.flags);
+    workers[i]->demangler.set_incremental(opts.incremental);
+    if (opts.name_cache_size) {
+      workers[i]->name_cache.reset(new NameCache(opts.name_cache_size));
+      workers[i]->demangler.set_name_cache(workers[i]->name_cache.get());
+    }
+  }
+}
+
+// Calls fn(demangler, i, begin, end) for each block [begin, end) of
+// [0, n), where i is the index of the block. Blocks are processed by
+// worker threads, each of which uses its own Demangler.
+template <typename Fn> void BatchDemangler::for_each_block(size_t n, Fn fn) {
+  size_t num_blocks = (n + block_size - 1) / block_size;
+  unsigned threads = std::min<size_t>(opts.threads, num_blocks);
+
+  std::atomic<size_t> next_block(0);
+  auto work = [&](Demangler &demangler) {
+    for (;;) {
+      size_t i = next_block++;
+      if (i >= num_blocks)
+        return;
+      fn(demangler, i, i * block_size, std::min(n, (i + 1) * block_size));
+    }
+  };
+
+  if (threads <= 1) {
+    work(workers[0]->demangler);
+    return;
+  }
+
+  std::vector<std::thread> pool;
+  for (unsigned i = 0; i < threads; ++i)
+    pool.emplace_back(work, std::ref(workers[i]->demangler));
+  for (std::thread &t : pool)
+    t.join();
+}
+
+void BatchDemangler::demangle_lines(const std::vector<String> &syms,
+                                    std::string &out) {
+  if (opts.threads == 1) {
+    ms_demangle::demangle_lines(workers[0]->demangler, syms.data(),
+                                syms.size(), out, opts.cache);
+    return;
+  }
+
+  blocks.resize((syms.size() + block_size - 1) / block_size);
+  for_each_block(syms.size(),
+                 [&](Demangler &d, size_t i, size_t begin, size_t end) {
+                   blocks[i].clear();
+                   ms_demangle::demangle_lines(d, syms.data() + begin,
+                                               end - begin, blocks[i],
+                                               opts.cache);
+                 });
+
+  for (std::string &s : blocks)
+    out += s;
+}
+
+std::vector<std::string>
+BatchDemangler::demangle(const std::vector<String> &syms) {
+  std::vector<std::string> out(syms.size());
+  ResultCache *cache = opts.cache;
+
+  for_each_block(syms.size(),
+                 [&](Demangler &d, size_t, size_t begin, size_t end) {
+                   for (size_t i = begin; i < end; ++i)
+                     if (!cache || !cache->lookup(syms[i], out[i]))
+                       out[i] = demangle_one(d, syms[i], cache).str();
+                 });
+  return out;
+}
+
+namespace {
+// A block of input lines and its results. Blocks are passed from the
+// reader to a worker, then to the writer, and then back to the reader.
+struct Block {
+  size_t seq = 0;
+  std::vector<char> buf;
+  std::vector<String> lines;
+  std::string out;
+};
+
+// A queue of blocks shared by threads. It is not bounded by itself;
+// the number of blocks in all queues is.
+class BlockQueue {
+public:
+  void push(Block *b) {
+    std::lock_guard<std::mutex> lock(mu);
+    q.push_back(b);
+    cv.notify_one();
+  }
+
+  // Waits for a block. Returns null if the queue is closed and empty.
+  Block *pop() {
+    std::unique_lock<std::mutex> lock(mu);
+    cv.wait(lock, [&] { return !q.empty() || closed; });
+    if (q.empty())
+      return nullptr;
+    Block *b = q.front();
+    q.pop_front();
+    return b;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lock(mu);
+    closed = true;
+    cv.notify_all();
+  }
+
+private:
+  std::mutex mu;
+  std::condition_variable cv;
+  std::deque<Block *> q;
+  bool closed = false;
+};
+} // namespace
+
+// The size of a read. Results are written in blocks of about the same
+// size.
+static constexpr size_t stream_block_size = 1 << 20;
+
+void BatchDemangler::demangle_stream(FILE *in, FILE *out) {
+  // Two blocks per worker keep workers busy while the reader and the
+  // writer handle two more.
+  std::vector<Block> blocks(opts.threads * 2 + 2);
+  BlockQueue free_blocks, input, output;
+  for (Block &b : blocks)
+    free_blocks.push(&b);
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < opts.threads; ++i) {
+    threads.emplace_back([&, i] {
+      while (Block *b = input.pop()) {
+        b->out.clear();
+        ms_demangle::demangle_lines(workers[i]->demangler, b->lines.data(),
+                                    b->lines.size(), b->out, opts.cache);
+        output.push(b);
+      }
+    });
+  }
+
+  // Blocks are finished out of order, so the writer keeps them until
+  // all preceding blocks are written.
+  std::thread writer([&] {
+    std::map<size_t, Block *> pending;
+    size_t next = 0;
+    while (Block *b = output.pop()) {
+      pending[b->seq] = b;
+      for (auto it = pending.find(next); it != pending.end();
+           it = pending.find(++next)) {
+        Block *done = it->second;
+        pending.erase(it);
+        fwrite(done->out.data(), 1, done->out.size(), out);
+        free_blocks.push(done);
+      }
+    }
+  });
+
+  // A line that is not terminated at the end of a read is moved to the
+  // next block.
+  std::string carry;
+  for (size_t seq = 0;; ++seq) {
+    Block *b = free_blocks.pop();
+    b->seq = seq;
+    b->lines.clear();
+    b->buf.resize(carry.size() + stream_block_size + 1);
+    memcpy(b->buf.data(), carry.data(), carry.size());
+
+    size_t n = fread(b->buf.data() + carry.size(), 1, stream_block_size, in);
+    size_t end = carry.size() + n;
+    if (n == 0) {
+      if (end == 0) {
+        free_blocks.push(b);
+        break;
+      }
+      // The last line of the input is not terminated by '\n'.
+      b->buf[end++] = '\n';
+    }
+
+    size_t pos = split_lines(b->buf.data(), end, b->lines);
+    carry.assign(b->buf.data() + pos, end - pos);
+    input.push(b);
+    if (n == 0)
+      break;
+  }
+
+  input.close();
+  for (std::thread &t : threads)
+    t.join();
+  output.close();
+  writer.join();
+}
+
+NameCache::Stats BatchDemangler::name_cache_stats() const {
+  NameCache::Stats total;
+  for (const std::unique_ptr<Worker> &w : workers) {
+    if (!w->name_cache)
+      continue;
+    const NameCache::Stats &s = w->name_cache->stats();
+    total.hits += s.hits;
+    total.misses += s.misses;
+    total.entries += s.entries;
+    total.bytes += s.bytes;
+    total.flushes += s.flushes;
+  }
+  return total;
+}
+
+Demangler::Stats BatchDemangler::demangler_stats() const {
+  Demangler::Stats total;
+  for (const std::unique_ptr<Worker> &w : workers)
+    total.merge(w->demangler.stats());
+  return total;
+}
+
+Demangler::Trace BatchDemangler::demangler_trace() const {
+  Demangler::Trace total;
+  for (const std::unique_ptr<Worker> &w : workers)
+    total.merge(w->demangler.trace());
+  return total;
+}
+
+void ms_demangle::demangle_lines_parallel(const std::vector<String> &syms,
+                                          unsigned threads, std::string &out,
+                                          ResultCache *cache) {
+  BatchDemangler::Options opts;
+  opts.threads = threads;
+  opts.cache = cache;
+  BatchDemangler(opts).demangle_lines(syms, out);
+}
+
+std::vector<std::string>
+ms_demangle::demangle_parallel(const std::vector<String> &syms,
+                               unsigned threads, ResultCache *cache) {
+  BatchDemangler::Options opts;
+  opts.threads = threads;
+  opts.cache = cache;
+  return BatchDemangler(opts).demangle(syms);
+}
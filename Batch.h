@@ -0,0 +1,146 @@
+//===- Batch.h --------------------------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares functions to demangle many symbols at once.
+//
+// The demangler is used in batch mode to process symbol dumps from large
+// programs, which often contain tens of millions of symbols. Functions in
+// this file read symbols in large blocks and demangle them with one
+// Demangler per thread, so that they don't pay for process startup or
+// memory allocation for each symbol.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "MicrosoftDemangle.h"
+#include "ResultCache.h"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ms_demangle {
+
+// Reads a file in large blocks and splits them into lines. Lines are
+// returned as Strings pointing into an internal buffer, so they are
+// valid only until the next call of next().
+class LineReader {
+public:
+  LineReader(FILE *in) : in(in) {}
+
+  // Replaces the contents of lines with the lines in the next block.
+  // A trailing '\r' is removed from each line. Returns false at EOF.
+  bool next(std::vector<String> &lines);
+
+private:
+  static constexpr size_t block_size = 1 << 20;
+
+  FILE *in;
+  std::vector<char> buf;
+
+  // The position and length of a line that was not terminated in the
+  // previous block.
+  size_t carry_pos = 0;
+  size_t carry = 0;
+  bool eof = false;
+};
+
+// Demangles symbols and appends the results to out, each followed by
+// '\n'. Symbols that cannot be demangled are appended as-is. If cache
+// is not null, results are looked up in and added to it.
+void demangle_lines(Demangler &demangler, const String *syms, size_t n,
+                    std::string &out, ResultCache *cache = nullptr);
+
+// Demangles symbols with a set of worker threads. The input is split
+// into blocks, and each thread demangles blocks with its own Demangler.
+// Results are in input order.
+//
+// Threads are started for each call, but Demanglers and NameCaches are
+// kept across calls, so their memory and cached names are reused while
+// a long input is fed block by block.
+class BatchDemangler {
+public:
+  struct Options {
+    unsigned threads = 1;
+
+    // If not null, this cache is shared by all threads.
+    ResultCache *cache = nullptr;
+
+    // If not zero, each thread has a NameCache of this size.
+    size_t name_cache_size = 0;
+
+    Demangler::Limits limits;
+
+    // RenderFlags given to each Demangler. A ResultCache must not be
+    // shared by BatchDemanglers with different flags.
+    uint8_t flags = 0;
+
+    // Enables Demangler::set_incremental() for sorted input.
+    bool incremental = false;
+  };
+
+  explicit BatchDemangler(const Options &opts);
+
+  // Same as ms_demangle::demangle_lines().
+  void demangle_lines(const std::vector<String> &syms, std::string &out);
+
+  // Returns one result per symbol.
+  std::vector<std::string> demangle(const std::vector<String> &syms);
+
+  // Reads symbols from in, one per line, and writes results to out in
+  // the same way as demangle_lines(). The calling thread reads blocks
+  // of lines, worker threads demangle them, and another thread writes
+  // results in input order, so I/O and demangling overlap. Only a few
+  // blocks per thread exist at once, and the reader waits for one to
+  // be written when all are in use, so memory use does not depend on
+  // the size of the input.
+  void demangle_stream(FILE *in, FILE *out);
+
+  // Returns the sum of statistics of all threads' NameCaches.
+  NameCache::Stats name_cache_stats() const;
+
+  // Returns statistics of all threads' Demanglers combined.
+  Demangler::Stats demangler_stats() const;
+
+  // Returns Demangler::trace() of all threads combined.
+  Demangler::Trace demangler_trace() const;
+
+private:
+  struct Worker {
+    Demangler demangler;
+    std::unique_ptr<NameCache> name_cache;
+  };
+
+  template <typename Fn> void for_each_block(size_t n, Fn fn);
+
+  Options opts;
+  std::vector<std::unique_ptr<Worker>> workers;
+
+  // Output buffers for blocks of demangle_lines().
+  std::vector<std::string> blocks;
+};
+
+// Same as demangle_lines(), but uses a given number of threads.
+void demangle_lines_parallel(const std::vector<String> &syms,
+                             unsigned threads, std::string &out,
+                             ResultCache *cache = nullptr);
+
+// Demangles symbols using a given number of threads and returns one
+// result per symbol in input order. Symbols that cannot be demangled
+// are returned as-is.
+std::vector<std::string> demangle_parallel(const std::vector<String> &syms,
+                                           unsigned threads,
+                                           ResultCache *cache = nullptr);
+
+} // namespace ms_demangle
+
+#endif
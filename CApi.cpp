@@ -0,0 +1,59 @@
+//===- CApi.cpp -----------------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CApi.h"
+#include "MicrosoftDemangle.h"
+
+using namespace ms_demangle;
+
+namespace {
+// Copies tokens to a fixed-size buffer and counts bytes that don't fit.
+class BufferSink : public Sink {
+public:
+  BufferSink(char *buf, size_t cap) : buf(buf), cap(cap) {}
+
+  void append(TokenKind, String s) override {
+    if (len < cap)
+      memcpy(buf + len, s.p, std::min(s.len, cap - len));
+    len += s.len;
+  }
+
+  char *buf;
+  size_t cap;
+  size_t len = 0;
+};
+} // namespace
+
+ptrdiff_t msvc_demangle(const char *in, size_t len, char *out, size_t cap) {
+  alignas(std::max_align_t) char scratch[MSVC_DEMANGLE_SCRATCH_SIZE];
+  return msvc_demangle_scratch(in, len, out, cap, scratch, sizeof(scratch));
+}
+
+ptrdiff_t msvc_demangle_scratch(const char *in, size_t len, char *out,
+                                size_t cap, void *scratch,
+                                size_t scratch_size) {
+  Demangler demangler(scratch, scratch_size);
+  demangler.reset(String(in, len));
+  demangler.parse();
+
+  // Leave room for the terminator.
+  BufferSink sink(out, cap ? cap - 1 : 0);
+  if (!demangler.error)
+    demangler.write(sink);
+
+  if (demangler.error) {
+    if (cap)
+      out[0] = '\0';
+    return (demangler.error == OutOfMemory) ? MSVC_DEMANGLE_NO_MEMORY
+                                            : MSVC_DEMANGLE_INVALID;
+  }
+  if (cap)
+    out[std::min(sink.len, cap - 1)] = '\0';
+  return sink.len;
+}
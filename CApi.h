@@ -0,0 +1,62 @@
+/*===- CApi.h - C interface to the demangler ------------------------*- C -*-===*\
+|*                                                                            *|
+|*                     The LLVM Compiler Infrastructure                       *|
+|*                                                                            *|
+|* This file is dual licensed under the MIT and the University of Illinois    *|
+|* Open Source Licenses. See LICENSE.TXT for details.                         *|
+|*                                                                            *|
+|*===----------------------------------------------------------------------===*|
+|*                                                                            *|
+|* This header declares a C interface to demangle a symbol into a buffer     *|
+|* given by the caller. It does not allocate memory from the heap, so it    *|
+|* can be used in crash handlers and other places where calling malloc or   *|
+|* operator new is not allowed.                                             *|
+|*                                                                            *|
+\*===----------------------------------------------------------------------===*/
+
+#ifndef CAPI_H
+#define CAPI_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Negative values returned by msvc_demangle(). */
+enum {
+  MSVC_DEMANGLE_INVALID = -1,   /* The symbol cannot be demangled. */
+  MSVC_DEMANGLE_NO_MEMORY = -2  /* The scratch buffer is too small. */
+};
+
+/* The size of the scratch buffer that msvc_demangle() allocates on the
+ * stack. It is enough for all but a few very long symbols, for which
+ * msvc_demangle() returns MSVC_DEMANGLE_NO_MEMORY. Use
+ * msvc_demangle_scratch() with a larger buffer for them. */
+#define MSVC_DEMANGLE_SCRATCH_SIZE 2048
+
+/* Demangles in[0, len) and writes the result to out as a NUL-terminated
+ * string, truncated to cap - 1 bytes if it does not fit. Returns the
+ * length of the entire result, like snprintf(), so the result was
+ * truncated if the return value is not less than cap. Returns a negative
+ * MSVC_DEMANGLE_* value on error. Names not starting with '?' are copied
+ * as they are. out may be null if cap is zero.
+ *
+ * This uses the scratch buffer, about 2 KiB for the demangler state,
+ * and about 250 bytes for each level of nesting in the symbol. That is
+ * less than 8 KiB, which is SIGSTKSZ on most systems, for the symbols
+ * of real programs we have tried, but crafted symbols nested up to the
+ * depth limit of 256 may need up to 64 KiB. */
+ptrdiff_t msvc_demangle(const char *in, size_t len, char *out, size_t cap);
+
+/* Same as msvc_demangle(), but uses scratch[0, scratch_size) instead of
+ * a buffer on the stack. The rest of the stack use is the same. */
+ptrdiff_t msvc_demangle_scratch(const char *in, size_t len, char *out,
+                                size_t cap, void *scratch,
+                                size_t scratch_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,338 @@
+//===- CoffReader.cpp -----------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The file formats are described in the Microsoft PE and COFF
+// specification. Only the parts needed to find symbol names are read.
+// All multi-byte fields are little-endian and may be unaligned.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CoffReader.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <vector>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace ms_demangle;
+
+#ifdef _WIN32
+// Memory mapping is not implemented on Windows. Read the whole file
+// into memory instead.
+MappedFile::~MappedFile() { free(addr); }
+
+bool MappedFile::open(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return false;
+  std::vector<char> buf;
+  char tmp[65536];
+  while (size_t n = fread(tmp, 1, sizeof(tmp), f))
+    buf.insert(buf.end(), tmp, tmp + n);
+  fclose(f);
+
+  addr = malloc(buf.size() ? buf.size() : 1);
+  memcpy(addr, buf.data(), buf.size());
+  size = buf.size();
+  return true;
+}
+#else
+MappedFile::~MappedFile() {
+  if (addr)
+    munmap(addr, size);
+}
+
+bool MappedFile::open(const char *path) {
+  int fd = ::open(path, O_RDONLY);
+  if (fd == -1)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return false;
+  }
+
+  // mmap fails for empty files. An empty file is just a file with no
+  // symbols, so represent it as an empty String.
+  if (st.st_size == 0) {
+    close(fd);
+    return true;
+  }
+
+  void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  int saved = errno;
+  close(fd);
+  if (p == MAP_FAILED) {
+    errno = saved;
+    return false;
+  }
+  addr = p;
+  size = st.st_size;
+  return true;
+}
+#endif
+
+static uint16_t read16(const char *p) {
+  const uint8_t *q = (const uint8_t *)p;
+  return q[0] | (q[1] << 8);
+}
+
+static uint32_t read32(const char *p) {
+  const uint8_t *q = (const uint8_t *)p;
+  return q[0] | (q[1] << 8) | (q[2] << 16) | ((uint32_t)q[3] << 24);
+}
+
+// Returns a NUL-terminated string at a given offset, or an empty
+// String if it is not terminated within data.
+static String read_cstr(String data, size_t off) {
+  if (off >= data.len)
+    return {};
+  const char *p = data.p + off;
+  const char *end = (const char *)memchr(p, '\0', data.len - off);
+  if (!end)
+    return {};
+  return {p, (size_t)(end - p)};
+}
+
+namespace {
+// A walker over a single file. It keeps the callback and the error
+// string so that member functions don't have to pass them around.
+struct Reader {
+  bool read_file(String data);
+  bool read_archive(String data);
+  bool read_object(String data);
+  bool read_bigobj(String data);
+  bool read_import(String data);
+  bool read_pe(String data);
+  bool read_exports(String data, String opt, String sections);
+  bool read_symtab(String data, uint32_t ptr, uint32_t nsyms, size_t symsize);
+
+  bool fail(const char *msg) {
+    error = msg;
+    return false;
+  }
+
+  const std::function<void(String)> &fn;
+  std::string &error;
+};
+} // namespace
+
+static constexpr char archive_magic[] = "!<arch>\n";
+
+// The ClassID of /bigobj object files. This is the GUID
+// D1BAA1C7-BAEE-4BA9-AF20-FAF66AA4DCB8 in its in-memory byte order.
+static constexpr char bigobj_class_id[] = "\xC7\xA1\xBA\xD1\xEE\xBA\xA9\x4B"
+                                          "\xAF\x20\xFA\xF6\x6A\xA4\xDC\xB8";
+
+bool Reader::read_file(String data) {
+  if (data.startswith(archive_magic))
+    return read_archive(data);
+  if (data.startswith("MZ"))
+    return read_pe(data);
+
+  // Import objects and bigobj files start with 0x0000 0xFFFF, which is
+  // an invalid machine type with no sections for regular objects.
+  if (data.len >= 6 && read16(data.p) == 0 && read16(data.p + 2) == 0xFFFF) {
+    if (read16(data.p + 4) == 0)
+      return read_import(data);
+    if (data.len >= 28 && memcmp(data.p + 12, bigobj_class_id, 16) == 0)
+      return read_bigobj(data);
+    // Other anonymous objects, such as LTCG bitcode objects, have no
+    // COFF symbol table.
+    return true;
+  }
+  return read_object(data);
+}
+
+// An archive is "!<arch>\n" followed by members. Each member has a
+// 60-byte header whose size field is a decimal number in ASCII. Members
+// are aligned to 2 bytes.
+bool Reader::read_archive(String data) {
+  size_t off = sizeof(archive_magic) - 1;
+
+  while (off < data.len) {
+    if (data.len - off < 60)
+      return fail("truncated archive member header");
+    String hdr = data.substr(off, 60);
+    if (!hdr.substr(58).startswith("`\n"))
+      return fail("bad archive member header");
+
+    char buf[11] = {};
+    memcpy(buf, hdr.p + 48, 10);
+    char *end;
+    unsigned long size = strtoul(buf, &end, 10);
+    off += 60;
+    if (end == buf || size > data.len - off)
+      return fail("bad archive member size");
+
+    // Skip the linker members ("/") and the long name table ("//").
+    // Other special members, such as "/<ECSYMBOLS>/", also start with
+    // '/' followed by a non-digit. Regular members with long names are
+    // named "/<decimal offset>".
+    bool special = hdr.p[0] == '/' && !('0' <= hdr.p[1] && hdr.p[1] <= '9');
+    if (!special && !read_file(data.substr(off, size)))
+      return false;
+    off += size + (size & 1);
+  }
+  return true;
+}
+
+// The symbol table is an array of records of symsize bytes, followed by
+// the string table. Names of up to 8 bytes are stored in records, and
+// longer names are stored in the string table.
+bool Reader::read_symtab(String data, uint32_t ptr, uint32_t nsyms,
+                         size_t symsize) {
+  if (ptr == 0 || nsyms == 0)
+    return true;
+  if (ptr > data.len || (data.len - ptr) / symsize < nsyms)
+    return fail("truncated symbol table");
+
+  String strtab;
+  size_t stroff = ptr + (size_t)nsyms * symsize;
+  if (data.len - stroff >= 4) {
+    uint32_t size = read32(data.p + stroff);
+    if (size > data.len - stroff)
+      return fail("truncated string table");
+    strtab = data.substr(stroff, size);
+  }
+
+  for (uint32_t i = 0; i < nsyms; ++i) {
+    const char *sym = data.p + ptr + i * symsize;
+    uint8_t storage_class = sym[symsize - 2];
+    uint8_t num_aux = sym[symsize - 1];
+
+    // Skip .file symbols, whose auxiliary records contain file names.
+    const uint8_t IMAGE_SYM_CLASS_FILE = 103;
+    if (storage_class != IMAGE_SYM_CLASS_FILE) {
+      String name;
+      if (read32(sym) == 0)
+        name = read_cstr(strtab, read32(sym + 4));
+      else
+        name = {sym, strnlen(sym, 8)};
+      if (!name.empty())
+        fn(name);
+    }
+    i += num_aux;
+  }
+  return true;
+}
+
+// A COFF object file starts with a 20-byte file header.
+bool Reader::read_object(String data) {
+  if (data.len < 20)
+    return fail("truncated COFF header");
+  return read_symtab(data, read32(data.p + 8), read32(data.p + 12), 18);
+}
+
+// A /bigobj object file starts with a 56-byte header, and its symbol
+// records are 20 bytes long to hold 32-bit section numbers.
+bool Reader::read_bigobj(String data) {
+  if (data.len < 56)
+    return fail("truncated bigobj header");
+  return read_symtab(data, read32(data.p + 48), read32(data.p + 52), 20);
+}
+
+// An import object in an import library consists of a 20-byte header,
+// the NUL-terminated symbol name and the DLL name.
+bool Reader::read_import(String data) {
+  if (data.len < 20)
+    return fail("truncated import header");
+  String name = read_cstr(data, 20);
+  if (!name.empty())
+    fn(name);
+  return true;
+}
+
+// A PE image starts with an MS-DOS stub, whose field at 0x3c points to
+// the "PE\0\0" signature followed by a COFF file header, the optional
+// header and section headers.
+bool Reader::read_pe(String data) {
+  if (data.len < 0x40)
+    return fail("truncated MS-DOS header");
+  uint32_t off = read32(data.p + 0x3c);
+  if (off > data.len || data.len - off < 24)
+    return fail("truncated PE header");
+  if (memcmp(data.p + off, "PE\0\0", 4) != 0)
+    return fail("bad PE signature");
+
+  String hdr = data.substr(off + 4);
+  uint16_t nsections = read16(hdr.p + 2);
+  uint16_t optsize = read16(hdr.p + 16);
+  if (hdr.len - 20 < optsize + nsections * 40u)
+    return fail("truncated PE header");
+
+  String opt = hdr.substr(20, optsize);
+  String sections = hdr.substr(20 + optsize, nsections * 40);
+  if (!read_exports(data, opt, sections))
+    return false;
+  return read_symtab(data, read32(hdr.p + 8), read32(hdr.p + 12), 18);
+}
+
+// Reads names in the export table of a PE image. Export names are
+// found through RVAs, so they are converted to file offsets using the
+// section table.
+bool Reader::read_exports(String data, String opt, String sections) {
+  if (opt.len < 2)
+    return true;
+
+  // PE32 and PE32+ have different offsets for the data directories.
+  size_t dir;
+  switch (read16(opt.p)) {
+  case 0x10b: dir = 96; break;
+  case 0x20b: dir = 112; break;
+  default: return fail("unknown optional header magic");
+  }
+  if (opt.len < dir + 8 || read32(opt.p + dir - 4) == 0)
+    return true;
+
+  auto rva_to_offset = [&](uint32_t rva) -> size_t {
+    for (size_t i = 0; i < sections.len; i += 40) {
+      const char *sec = sections.p + i;
+      uint32_t va = read32(sec + 12);
+      uint32_t size = std::max(read32(sec + 8), read32(sec + 16));
+      if (va <= rva && rva - va < size)
+        return (size_t)read32(sec + 20) + (rva - va);
+    }
+    return data.len;
+  };
+
+  uint32_t export_rva = read32(opt.p + dir);
+  if (export_rva == 0)
+    return true;
+  size_t edir = rva_to_offset(export_rva);
+  if (edir > data.len || data.len - edir < 40)
+    return fail("truncated export directory");
+
+  uint32_t nnames = read32(data.p + edir + 24);
+  size_t names = rva_to_offset(read32(data.p + edir + 32));
+  if (names > data.len || (data.len - names) / 4 < nnames)
+    return fail("truncated export name table");
+
+  for (uint32_t i = 0; i < nnames; ++i) {
+    String name = read_cstr(data, rva_to_offset(read32(data.p + names + i * 4)));
+    if (!name.empty())
+      fn(name);
+  }
+  return true;
+}
+
+bool ms_demangle::for_each_coff_symbol(String data,
+                                       const std::function<void(String)> &fn,
+                                       std::string &error) {
+  return Reader{fn, error}.read_file(data);
+}
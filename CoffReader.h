@@ -0,0 +1,59 @@
+//===- CoffReader.h ---------------------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares a reader for symbol names in COFF object files
+// (.obj), archives of them (.lib) and PE images (.exe and .dll).
+//
+// Files are memory-mapped, and symbol names are handed out as Strings
+// pointing directly into the mappings, so that names can be passed to
+// the demangler without being copied.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef COFF_READER_H
+#define COFF_READER_H
+
+#include "MicrosoftDemangle.h"
+
+#include <functional>
+#include <string>
+
+namespace ms_demangle {
+
+// A read-only memory-mapped file.
+class MappedFile {
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+
+  // Maps a given file. Returns false and sets errno on failure.
+  bool open(const char *path);
+
+  String data() const { return {(const char *)addr, size}; }
+
+private:
+  void *addr = nullptr;
+  size_t size = 0;
+};
+
+// Calls fn for each symbol name in a COFF object file (regular or
+// /bigobj), an import object, a PE image or an archive of them. data is
+// the contents of a file, and names are substrings of it. Returns false
+// and sets error if the file is not in a known format or is truncated.
+//
+// For PE images, names come from the export table and from the COFF
+// symbol table, which linkers usually leave empty.
+bool for_each_coff_symbol(String data, const std::function<void(String)> &fn,
+                          std::string &error);
+
+} // namespace ms_demangle
+
+#endif
@@ -0,0 +1,94 @@
+//===- Filter.cpp ---------------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Filter.h"
+#include "Scan.h"
+
+using namespace ms_demangle;
+
+void TextFilter::filter(String text, std::string &out) {
+  const char *p = text.p;
+  const char *end = text.p + text.len;
+
+  // Text before this position has been appended to out.
+  const char *done = p;
+
+  while (p < end) {
+    p += find_byte(p, end - p, '?');
+    if (p == end)
+      break;
+
+    // If the '?' is in the middle of a run of symbol characters, the
+    // whole run is not a symbol.
+    size_t len = count_symbol_chars(p, end - p);
+    char c = (p == text.p) ? prev : p[-1];
+    if (is_symbol_char(c)) {
+      p += len;
+      continue;
+    }
+
+    demangler.reset(String(p, len));
+    demangler.parse();
+    if (!demangler.error) {
+      // view() fails if the result is too long.
+      String s = demangler.view();
+      if (!demangler.error) {
+        out.append(done, p - done);
+        out.append(s.p, s.len);
+
+        // Bytes of the run after the symbol are copied as they are.
+        // With NameOnly, parse() does not read types, so validate()
+        // finds where the symbol ends.
+        Demangler::SymbolInfo info;
+        if (demangler.get_flags() & NameOnly)
+          demangler.validate(String(p, len), info);
+        done = p + demangler.consumed();
+      }
+    }
+    p += len;
+  }
+
+  out.append(done, end - done);
+  if (text.len)
+    prev = end[-1];
+}
+
+void TextFilter::run(FILE *in, FILE *out) {
+  std::vector<char> buf(block_size);
+  std::string res;
+  size_t carry = 0;
+
+  for (;;) {
+    size_t n = fread(buf.data() + carry, 1, block_size - carry, in);
+    size_t end = carry + n;
+    if (end == 0)
+      return;
+
+    // A run of symbol characters at the end of a block may continue in
+    // the next block, so it is carried over unless this is the last
+    // block. A run filling the entire buffer is too long to be a symbol
+    // and is not carried.
+    size_t cut = end;
+    if (n) {
+      while (cut > 0 && is_symbol_char(buf[cut - 1]))
+        cut--;
+      if (cut == 0)
+        cut = end;
+    }
+
+    res.clear();
+    filter(String(buf.data(), cut), res);
+    fwrite(res.data(), 1, res.size(), out);
+
+    carry = end - cut;
+    memmove(buf.data(), buf.data() + cut, carry);
+    if (n == 0)
+      return;
+  }
+}
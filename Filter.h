@@ -0,0 +1,59 @@
+//===- Filter.h -------------------------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares a filter which demangles MSVC-style symbols found in
+// free text, such as linker errors and map files, like c++filt does.
+//
+// A candidate symbol is a '?' that is not preceded by a character that
+// may appear in mangled names, followed by the longest run of such
+// characters. Candidates are demangled in place, and those that cannot
+// be demangled are left untouched. Text is scanned with the functions
+// in Scan.h, and candidates are given to the Demangler as Strings
+// pointing into the input buffer.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include "MicrosoftDemangle.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace ms_demangle {
+
+class TextFilter {
+public:
+  // Symbols are demangled with a given Demangler, so its limits and
+  // flags apply.
+  explicit TextFilter(Demangler &demangler) : demangler(demangler) {}
+
+  // Filters a block of text and appends the result to out. Consecutive
+  // calls are treated as a continuous text, but a symbol split between
+  // two blocks is not found.
+  void filter(String text, std::string &out);
+
+  // Filters the contents of in and writes the result to out.
+  void run(FILE *in, FILE *out);
+
+private:
+  static constexpr size_t block_size = 1 << 20;
+
+  Demangler &demangler;
+
+  // The last character of the previous block, which decides if a '?'
+  // at the beginning of the next block can start a symbol.
+  char prev = '\n';
+};
+
+} // namespace ms_demangle
+
+#endif
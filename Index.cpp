@@ -0,0 +1,237 @@
+//===- Index.cpp ----------------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Index.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+using namespace ms_demangle;
+
+static constexpr char index_magic[] = "MSDMIDX1";
+
+// The size of the header: the magic and seven 64-bit fields.
+static constexpr size_t header_size = 8 + 7 * 8;
+
+static void write64(std::string &out, uint64_t x) {
+  for (int i = 0; i < 8; ++i)
+    out.push_back((char)(x >> (i * 8)));
+}
+
+static uint64_t read64(const char *p) {
+  const uint8_t *q = (const uint8_t *)p;
+  uint64_t x = 0;
+  for (int i = 0; i < 8; ++i)
+    x |= (uint64_t)q[i] << (i * 8);
+  return x;
+}
+
+static void write_uleb(std::string &out, uint64_t x) {
+  do {
+    uint8_t b = x & 0x7f;
+    x >>= 7;
+    out.push_back((char)(x ? (b | 0x80) : b));
+  } while (x);
+}
+
+// Reads a LEB128 number at p and advances p. Returns false if the
+// number is not terminated before end.
+static bool read_uleb(const char *&p, const char *end, uint64_t &x) {
+  x = 0;
+  for (int shift = 0; p < end && shift < 64; shift += 7) {
+    uint8_t b = *p++;
+    x |= (uint64_t)(b & 0x7f) << shift;
+    if (!(b & 0x80))
+      return true;
+  }
+  return false;
+}
+
+static int compare(String a, String b) {
+  int c = memcmp(a.p, b.p, std::min(a.len, b.len));
+  if (c)
+    return c;
+  return (a.len < b.len) ? -1 : (a.len > b.len);
+}
+
+bool ms_demangle::write_index(BatchDemangler &batch,
+                              const std::vector<String> &syms,
+                              const char *path) {
+  std::vector<std::string> names = batch.demangle(syms);
+
+  std::vector<uint32_t> order(syms.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return names[a] < names[b];
+  });
+
+  std::string blocks, keys, pool;
+  String prev;
+  for (size_t i = 0; i < order.size(); ++i) {
+    String key = names[order[i]];
+    String sym = syms[order[i]];
+
+    size_t shared = 0;
+    if (i % Index::block_size == 0) {
+      write64(blocks, keys.size());
+    } else {
+      size_t n = std::min(prev.len, key.len);
+      while (shared < n && prev.p[shared] == key.p[shared])
+        shared++;
+    }
+
+    write_uleb(keys, shared);
+    write_uleb(keys, key.len - shared);
+    write_uleb(keys, pool.size());
+    write_uleb(keys, sym.len);
+    keys.append(key.p + shared, key.len - shared);
+    pool.append(sym.p, sym.len);
+    prev = key;
+  }
+
+  std::string header(index_magic, 8);
+  write64(header, order.size());
+  write64(header, blocks.size() / 8);
+  write64(header, header_size);
+  write64(header, header_size + blocks.size());
+  write64(header, keys.size());
+  write64(header, header_size + blocks.size() + keys.size());
+  write64(header, pool.size());
+
+  FILE *out = fopen(path, "wb");
+  if (!out)
+    return false;
+  for (const std::string *s : {&header, &blocks, &keys, &pool}) {
+    if (fwrite(s->data(), 1, s->size(), out) != s->size()) {
+      int saved = errno;
+      fclose(out);
+      errno = saved;
+      return false;
+    }
+  }
+  return fclose(out) == 0;
+}
+
+bool Index::open(const char *path, std::string &error) {
+  if (!file.open(path)) {
+    error = strerror(errno);
+    return false;
+  }
+
+  String data = file.data();
+  if (data.len < header_size || memcmp(data.p, index_magic, 8) != 0) {
+    error = "not an index file";
+    return false;
+  }
+
+  const char *h = data.p + 8;
+  num_entries = read64(h);
+  num_blocks = read64(h + 8);
+  uint64_t blocks_off = read64(h + 16);
+  uint64_t keys_off = read64(h + 24);
+  uint64_t keys_size = read64(h + 32);
+  uint64_t pool_off = read64(h + 40);
+  uint64_t pool_size = read64(h + 48);
+
+  if (blocks_off > data.len || num_blocks > (data.len - blocks_off) / 8 ||
+      keys_off > data.len || keys_size > data.len - keys_off ||
+      pool_off > data.len || pool_size > data.len - pool_off ||
+      num_blocks != (num_entries + block_size - 1) / block_size) {
+    error = "corrupted index file";
+    return false;
+  }
+
+  blocks = data.p + blocks_off;
+  keys = String(data.p + keys_off, keys_size);
+  pool = String(data.p + pool_off, pool_size);
+  for (uint64_t i = 0; i < num_blocks; ++i) {
+    if (read64(blocks + i * 8) >= keys.len) {
+      error = "corrupted index file";
+      return false;
+    }
+  }
+  return true;
+}
+
+// Decodes entries starting from the last block whose first key is less
+// than a given key, and calls fn(demangled, mangled) for each entry not
+// less than the key until fn returns false. Corrupted entries end the
+// scan.
+template <typename Fn> void Index::scan(String key, Fn fn) const {
+  if (num_blocks == 0)
+    return;
+
+  // Read the first key of a block.
+  auto first_key = [&](uint64_t i) -> String {
+    const char *p = keys.p + read64(blocks + i * 8);
+    const char *end = keys.p + keys.len;
+    uint64_t shared, unshared, off, len;
+    if (!read_uleb(p, end, shared) || !read_uleb(p, end, unshared) ||
+        !read_uleb(p, end, off) || !read_uleb(p, end, len) ||
+        unshared > (uint64_t)(end - p))
+      return {};
+    return String(p, unshared);
+  };
+
+  // Find the first block whose first key is not less than key.
+  uint64_t lo = 0, hi = num_blocks;
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (compare(first_key(mid), key) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  uint64_t block = lo ? lo - 1 : 0;
+
+  const char *p = keys.p + read64(blocks + block * 8);
+  const char *end = keys.p + keys.len;
+  std::string cur;
+  for (uint64_t i = block * block_size; i < num_entries; ++i) {
+    uint64_t shared, unshared, off, len;
+    if (!read_uleb(p, end, shared) || !read_uleb(p, end, unshared) ||
+        !read_uleb(p, end, off) || !read_uleb(p, end, len) ||
+        shared > cur.size() || unshared > (uint64_t)(end - p) ||
+        off > pool.len || len > pool.len - off)
+      return;
+
+    cur.resize(shared);
+    cur.append(p, unshared);
+    p += unshared;
+
+    String s = cur;
+    if (compare(s, key) < 0)
+      continue;
+    if (!fn(s, String(pool.p + off, len)))
+      return;
+  }
+}
+
+void Index::find_prefix(String prefix,
+                        const std::function<void(String, String)> &fn) const {
+  scan(prefix, [&](String name, String sym) {
+    if (!name.startswith(prefix))
+      return false;
+    fn(name, sym);
+    return true;
+  });
+}
+
+void Index::find(String name,
+                 const std::function<void(String, String)> &fn) const {
+  scan(name, [&](String s, String sym) {
+    if (!(s == name))
+      return false;
+    fn(s, sym);
+    return true;
+  });
+}
@@ -0,0 +1,84 @@
+//===- Index.h --------------------------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares an on-disk index of demangled names, which maps
+// demangled names and their prefixes back to mangled symbols.
+//
+// Demangling tens of millions of symbols for each query is slow, so the
+// index is built once and then memory-mapped by queries. It consists of
+// a header, sorted keys (demangled names) and a pool of mangled names:
+//
+//   header   magic "MSDMIDX1", followed by 64-bit little-endian fields:
+//            the numbers of entries and of blocks, and the offsets and
+//            sizes of the three sections below.
+//   blocks   64-bit offsets of every block_size-th entry in keys.
+//   keys     entries, each of which consists of LEB128 numbers (shared,
+//            unshared, offset, length) and unshared bytes. A key is the
+//            first `shared` bytes of the previous key followed by the
+//            unshared bytes. The first key of a block has shared == 0,
+//            so lookups can binary-search over blocks. The mangled name
+//            is pool[offset, offset + length).
+//   pool     mangled names.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef INDEX_H
+#define INDEX_H
+
+#include "Batch.h"
+#include "CoffReader.h"
+#include "MicrosoftDemangle.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace ms_demangle {
+
+// Demangles symbols with a given BatchDemangler and writes an index of
+// them to a file. Symbols that cannot be demangled are indexed by
+// themselves. Returns false and sets errno on failure.
+bool write_index(BatchDemangler &batch, const std::vector<String> &syms,
+                 const char *path);
+
+// A memory-mapped index. Looking up a name reads only the parts of the
+// file it needs.
+class Index {
+public:
+  // Returns false and sets error if the file cannot be read or is not
+  // a valid index.
+  bool open(const char *path, std::string &error);
+
+  size_t size() const { return num_entries; }
+
+  // Calls fn(demangled, mangled) for each entry whose demangled name
+  // starts with prefix, in the order of demangled names. The demangled
+  // name is valid only during the call.
+  void find_prefix(String prefix,
+                   const std::function<void(String, String)> &fn) const;
+
+  // Same as find_prefix(), but only for names equal to name.
+  void find(String name, const std::function<void(String, String)> &fn) const;
+
+  static constexpr size_t block_size = 16;
+
+private:
+  template <typename Fn> void scan(String key, Fn fn) const;
+
+  MappedFile file;
+  uint64_t num_entries = 0;
+  uint64_t num_blocks = 0;
+  const char *blocks = nullptr;
+  String keys;
+  String pool;
+};
+
+} // namespace ms_demangle
+
+#endif
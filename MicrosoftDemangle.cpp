@@ -7,335 +7,533 @@
 //
 //===----------------------------------------------------------------------===//
 //
-// This file defines a demangler for MSVC-style mangled symbols.
+// This file implements a demangler for MSVC-style mangled symbols.
 //
 // This file has no dependencies on the rest of LLVM so that it can be
 // easily reused in other programs such as libcxxabi.
 //
 //===----------------------------------------------------------------------===//
 
-#include <algorithm>
-#include <cassert>
-#include <cctype>
-#include <cstdlib>
-#include <cstring>
-#include <iostream>
-#include <memory>
-#include <numeric>
-#include <sstream>
-#include <string>
-#include <utility>
-#include <vector>
-
-// A string class that does not own its contents.
-// This class provides a few utility functions for string manipulations.
-class String {
-public:
-  String() = default;
-  String(const String &) = default;
-  String(const std::string &s) : p(s.data()), len(s.size()) {}
-  String(const char *p) : p(p), len(strlen(p)) {}
-  String(const char *p, size_t len) : p(p), len(len) {}
-  template <size_t N> String(const char (&p)[N]) : p(p), len(N - 1) {}
+#include "MicrosoftDemangle.h"
+#include "Scan.h"
 
-  std::string str() const { return {p, p + len}; }
-
-  bool empty() const { return len == 0; }
+#include <cctype>
+#include <initializer_list>
 
-  bool startswith(char c) const { return len > 0 && *p == c; }
+#if defined(DEMANGLE_STATS) || defined(DEMANGLE_TRACE)
+#include <chrono>
+#endif
 
-  bool startswith(const std::string &s) const {
-    return s.size() <= len && strncmp(p, s.data(), s.size()) == 0;
-  }
+using namespace ms_demangle;
 
-  bool startswith_digit() const {
-    return 0 < len && '0' <= p[0] && p[0] <= '9';
+// Macros to update Demangler::Stats. They expand to nothing unless
+// DEMANGLE_STATS is defined.
+#ifdef DEMANGLE_STATS
+namespace {
+// Keeps track of the depth of recursive calls.
+struct DepthScope {
+  DepthScope(size_t &depth, size_t &max) : depth(depth) {
+    max = std::max(max, ++depth);
   }
+  ~DepthScope() { --depth; }
+  size_t &depth;
+};
 
-  String substr(size_t off) const { return {p + off, len - off}; }
-  String substr(size_t off, size_t length) const { return {p + off, length}; }
+// Adds the lifetime of this object to a counter.
+struct TimerScope {
+  TimerScope(uint64_t &ns) : ns(ns) {}
+  ~TimerScope() { ns += elapsed(); }
 
-  bool operator==(const String s) const {
-    return len == s.len && memcmp(p, s.p, len) == 0;
+  uint64_t elapsed() const {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now() - start).count();
   }
 
-  void trim(size_t n) {
-    assert(n <= len);
-    p += n;
-    len -= n;
-  }
+  uint64_t &ns;
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+};
+} // namespace
 
-  int get() {
-    if (len == 0)
-      return -1;
-    len--;
-    return *p++;
+#define STAT(x) (x)
+#define STAT_DEPTH(depth, max) DepthScope depth_scope(depth, max)
+#define STAT_TIMER(ns) TimerScope timer_scope(ns)
+#else
+#define STAT(x)
+#define STAT_DEPTH(depth, max)
+#define STAT_TIMER(ns)
+#endif
+
+// TRACE_RULE(r) at the beginning of a function counts a call of rule r
+// and its time in Demangler::Trace. It expands to nothing unless
+// DEMANGLE_TRACE is defined.
+#ifdef DEMANGLE_TRACE
+namespace {
+struct RuleScope {
+  RuleScope(Demangler::Trace::Rule &rule, uint64_t &child_ns)
+      : rule(rule), child_ns(child_ns), saved_child_ns(child_ns) {
+    child_ns = 0;
   }
 
-  void unget(int c) {
-    if (c == -1)
-      return;
-    p--;
-    len++;
+  ~RuleScope() {
+    using namespace std::chrono;
+    uint64_t ns =
+        duration_cast<nanoseconds>(steady_clock::now() - start).count();
+    rule.calls++;
+    rule.total_ns += ns;
+    rule.self_ns += ns - child_ns;
+    child_ns = saved_child_ns + ns;
   }
 
-  const char *p = nullptr;
-  size_t len = 0;
+  Demangler::Trace::Rule &rule;
+  uint64_t &child_ns;
+  uint64_t saved_child_ns;
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
 };
+} // namespace
 
-std::ostream &operator<<(std::ostream &os, const String s) {
-  os.write(s.p, s.len);
-  return os;
-}
+#define TRACE_RULE(r) RuleScope rule_scope(tr.rules[r], trace_child_ns)
+#else
+#define TRACE_RULE(r)
+#endif
 
-// This memory allocator is extremely fast, but it doesn't call dtors
-// for allocated objects. That means you can't use STL containers
-// (such as std::vector) with this allocator. But it pays off --
-// the demangler is 3x faster with this allocator compared to one with
-// STL containers.
 namespace {
-class Arena {
-public:
-  void *alloc(size_t size) {
-    assert(size < unit);
-
-    uint8_t *p = buf + nused;
-    nused += size;
-    if (nused < unit)
-      return p;
+// A table to decode a byte of a mangled name. Bytes that have no
+// meaning have invalid entries. get() returns -1 at the end of input,
+// which is mapped to the invalid entry at 255.
+template <typename T> struct ByteTable {
+  struct Entry {
+    T value = T();
+    bool valid = false;
+  };
+
+  struct Init {
+    char c;
+    T value;
+  };
+
+  constexpr ByteTable(std::initializer_list<Init> list) {
+    for (const Init &e : list) {
+      entries[(uint8_t)e.c].value = e.value;
+      entries[(uint8_t)e.c].valid = true;
+    }
+  }
 
-    buf = new uint8_t[Arena::unit];
-    buf2.emplace_back(buf);
-    nused = size;
-    return buf;
+  constexpr const Entry &operator[](int c) const {
+    return entries[(uint8_t)c];
   }
 
-private:
-  static constexpr size_t unit = 4096;
+  Entry entries[256];
+};
+} // namespace
 
-  uint8_t *buf = init_buf;
-  alignas(sizeof(void *)) uint8_t init_buf[unit];
-  size_t nused = 0;
-  std::vector<std::unique_ptr<uint8_t[]>> buf2;
+static constexpr ByteTable<PrimTy> prim_types = {
+    {'X', Void},   {'D', Char}, {'C', Schar}, {'E', Uchar},  {'F', Short},
+    {'G', Ushort}, {'H', Int},  {'I', Uint},  {'J', Long},   {'K', Ulong},
+    {'M', Float},  {'N', Double}, {'O', Ldouble},
+};
+
+// Primitive types following '_'.
+static constexpr ByteTable<PrimTy> prim_types_ext = {
+    {'N', Bool}, {'J', Int64}, {'K', Uint64}, {'W', Wchar},
+};
+
+// Names of primitive types and keywords of classes, indexed by PrimTy.
+static constexpr String prim_names[] = {
+    // Unknown, None, Function, Ptr, Ref, Array and Backref
+    "", "", "", "", "", "", "",
+    // Struct, Union, Class and Enum
+    "struct", "union", "class", "enum",
+    // Void to Ldouble
+    "void", "bool", "char", "signed char", "unsigned char", "short",
+    "unsigned short", "int", "unsigned int", "long", "unsigned long",
+    "int64_t", "uint64_t", "wchar_t", "float", "double", "long double",
+};
+static_assert(sizeof(prim_names) / sizeof(*prim_names) == Ldouble + 1,
+              "prim_names must have an entry for each PrimTy");
+
+static constexpr ByteTable<String> operators = {
+    {'0', "ctor"}, {'1', "dtor"},  {'2', " new"}, {'3', " delete"},
+    {'4', "="},    {'5', ">>"},    {'6', "<<"},   {'7', "!"},
+    {'8', "=="},   {'9', "!="},    {'A', "[]"},   {'C', "->"},
+    {'D', "*"},    {'E', "++"},    {'F', "--"},   {'G', "-"},
+    {'H', "+"},    {'I', "&"},     {'J', "->*"},  {'K', "/"},
+    {'L', "%"},    {'M', "<"},     {'N', "<="},   {'O', ">"},
+    {'P', ">="},   {'Q', ","},     {'R', "()"},   {'S', "~"},
+    {'T', "^"},    {'U', "|"},     {'V', "&&"},   {'W', "||"},
+    {'X', "*="},   {'Y', "+="},    {'Z', "-="},
 };
-}
 
-void *operator new(size_t size, Arena &a) { return a.alloc(size); }
+// Operators following '_'.
+static constexpr ByteTable<String> operators_ext = {
+    {'0', "/="}, {'1', "%="}, {'2', ">>="},    {'3', "<<="},
+    {'4', "&="}, {'5', "|="}, {'6', "^="},     {'U', " new[]"},
+    {'V', " delete[]"},
+    {'_', " co_await"}, // "__L"
+};
 
-// Storage classes
-enum {
-  Const = 1 << 0,
-  Volatile = 1 << 1,
-  Far = 1 << 2,
-  Huge = 1 << 3,
-  Unaligned = 1 << 4,
-  Restrict = 1 << 5,
+static constexpr ByteTable<uint8_t> func_classes = {
+    {'A', Private},
+    {'B', Private | FFar},
+    {'C', Private | Static},
+    {'D', Private | Static},
+    {'E', Private | Virtual},
+    {'F', Private | Virtual},
+    {'I', Protected},
+    {'J', Protected | FFar},
+    {'K', Protected | Static},
+    {'L', Protected | Static | FFar},
+    {'M', Protected | Virtual},
+    {'N', Protected | Virtual | FFar},
+    {'Q', Public},
+    {'R', Public | FFar},
+    {'S', Public | Static},
+    {'T', Public | Static | FFar},
+    {'U', Public | Virtual},
+    {'V', Public | Virtual | FFar},
+    {'Y', Global},
+    {'Z', Global | FFar},
 };
 
-// Calling conventions
-enum CallingConv : uint8_t {
-  Cdecl,
-  Pascal,
-  Thiscall,
-  Stdcall,
-  Fastcall,
-  Regcall,
+static constexpr ByteTable<int8_t> access_classes = {
+    {'A', 0}, {'B', Const}, {'C', Volatile}, {'D', Const | Volatile},
 };
 
-// Types
-enum PrimTy : uint8_t {
-  Unknown,
-  None,
-  Function,
-  Ptr,
-  Ref,
-  Array,
-
-  Struct,
-  Union,
-  Class,
-  Enum,
-
-  Void,
-  Bool,
-  Char,
-  Schar,
-  Uchar,
-  Short,
-  Ushort,
-  Int,
-  Uint,
-  Long,
-  Ulong,
-  Int64,
-  Uint64,
-  Wchar,
-  Float,
-  Double,
-  Ldouble,
+static constexpr ByteTable<int8_t> storage_classes = {
+    {'A', 0},
+    {'B', Const},
+    {'C', Volatile},
+    {'D', Const | Volatile},
+    {'E', Far},
+    {'F', Const | Far},
+    {'G', Volatile | Far},
+    {'H', Const | Volatile | Far},
 };
 
-// Function classes
-enum FuncClass : uint8_t {
-  Public = 1 << 0,
-  Protected = 1 << 1,
-  Private = 1 << 2,
-  Global = 1 << 3,
-  Static = 1 << 4,
-  Virtual = 1 << 5,
-  FFar = 1 << 6,
+static constexpr ByteTable<CallingConv> calling_convs = {
+    {'A', Cdecl},    {'B', Cdecl},   {'C', Pascal},
+    {'E', Thiscall}, {'G', Stdcall}, {'I', Fastcall},
 };
 
 namespace {
-struct Type;
+// Chunks of the default size freed by Arenas on this thread. The list
+// is bounded so that a thread that once demangled a huge symbol does
+// not keep its memory forever. This struct is trivially destructible
+// so that it can still be used by Arenas that die at thread exit.
+struct ChunkPool {
+  static constexpr size_t capacity = 64;
+  uint8_t *chunks[capacity];
+  size_t size;
+  bool closed;
+};
+
+// Frees pooled chunks when the thread exits. Arenas destroyed after
+// that free their chunks themselves.
+struct ChunkPoolCleanup {
+  ~ChunkPoolCleanup() {
+    for (size_t i = 0; i < pool.size; ++i)
+      delete[] pool.chunks[i];
+    pool.size = 0;
+    pool.closed = true;
+  }
+  ChunkPool &pool;
+};
+} // namespace
+
+static ChunkPool &chunk_pool() {
+  static thread_local ChunkPool pool;
+  static thread_local ChunkPoolCleanup cleanup{pool};
+  return pool;
+}
+
+Arena::Arena(void *p, size_t size) : chunk_size(default_chunk_size) {
+  // Align the buffer because alloc() aligns offsets from its start.
+  size_t pad = -(uintptr_t)p % alignof(std::max_align_t);
+  pad = std::min(pad, size);
+  fixed_buf = (uint8_t *)p + pad;
+  fixed_size = size - pad;
+  buf = fixed_buf;
+  cap = fixed_size;
+}
+
+// Chunks are checked first because the first use of chunk_pool() on a
+// thread registers a destructor, which may allocate memory.
+Arena::~Arena() {
+  if (chunks.empty() || chunk_size != default_chunk_size)
+    return;
+  ChunkPool &pool = chunk_pool();
+  for (std::unique_ptr<uint8_t[]> &c : chunks) {
+    if (pool.closed || pool.size == ChunkPool::capacity)
+      return;
+    pool.chunks[pool.size++] = c.release();
+  }
+}
 
-// Represents an identifier which may be a template.
-struct Name {
-  // Name read from an input string.
-  String str;
+uint8_t *Arena::new_chunk() {
+  if (chunk_size == default_chunk_size) {
+    ChunkPool &pool = chunk_pool();
+    if (pool.size)
+      return pool.chunks[--pool.size];
+  }
+  return new uint8_t[chunk_size];
+}
 
-  // Overloaded operators are represented as special names in mangled symbols.
-  // If this is an operator name, "op" has an operator name (e.g. ">>").
-  // Otherwise, empty.
-  String op;
+// Called if the current chunk is full. Memory returned by new[] is
+// aligned for any type, so the new block needs no padding.
+void *Arena::alloc_slow(size_t size) {
+  if (fixed_buf)
+    return nullptr;
+
+  // Objects larger than half a chunk get blocks of their own so that
+  // they don't waste the rest of the current chunk.
+  if (size > chunk_size / 2) {
+#ifdef DEMANGLE_STATS
+    chunks_allocated++;
+#endif
+    large.emplace_back(new uint8_t[size]);
+    large_bytes += size;
+    return large.back().get();
+  }
 
-  // Template parameters. Null if not a template.
-  Type *params = nullptr;
+  if (nchunks == chunks.size()) {
+#ifdef DEMANGLE_STATS
+    chunks_allocated++;
+#endif
+    chunks.emplace_back(new_chunk());
+  }
+  buf = chunks[nchunks++].get();
+  cap = chunk_size;
+  nused = size;
+  return buf;
+}
 
-  // Nested names (e.g. "A::B::C") are represented as a linked list.
-  Name *next = nullptr;
-};
+void Demangler::Stats::merge(const Stats &s) {
+  symbols += s.symbols;
+  arena_bytes += s.arena_bytes;
+  arena_chunks += s.arena_chunks;
+  name_nodes += s.name_nodes;
+  type_nodes += s.type_nodes;
+  name_backrefs += s.name_backrefs;
+  param_backrefs += s.param_backrefs;
+  max_parse_depth = std::max(max_parse_depth, s.max_parse_depth);
+  max_write_depth = std::max(max_write_depth, s.max_write_depth);
+  parse_ns += s.parse_ns;
+  render_ns += s.render_ns;
+  if (s.slowest_ns > slowest_ns) {
+    slowest_ns = s.slowest_ns;
+    slowest = s.slowest;
+  }
+}
 
-// The type class. Mangled symbols are first parsed and converted to
-// this type and then converted to string.
-struct Type {
-  // Primitive type such as Int.
-  PrimTy prim;
+void Demangler::Trace::merge(const Trace &t) {
+  symbols += t.symbols;
+  for (int i = 0; i < NumTraceRules; ++i) {
+    rules[i].calls += t.rules[i].calls;
+    rules[i].total_ns += t.rules[i].total_ns;
+    rules[i].self_ns += t.rules[i].self_ns;
+  }
+}
 
-  // Represents a type X in "a pointer to X", "a reference to X",
-  // "an array of X", or "a function returning X".
-  Type *ptr = nullptr;
+const char *Demangler::Trace::rule_name(TraceRule r) {
+  static const char *const names[] = {
+      "read_name",    "read_var_type", "read_params",
+      "read_func_ptr", "read_array",   "read_operator",
+      "write_pre",    "write_post",    "write_params",
+      "write_name",   "write_tmpl_params", "write_class",
+  };
+  static_assert(sizeof(names) / sizeof(*names) == NumTraceRules,
+                "names of TraceRules");
+  return names[r];
+}
 
-  uint8_t sclass = 0;  // storage class
-  CallingConv calling_conv;
-  FuncClass func_class;
+Demangler::Stats Demangler::stats() const {
+  Stats s = st;
+  s.arena_bytes = arena.bytes_allocated;
+  s.arena_chunks = arena.chunks_allocated;
+  s.slowest.assign(slowest, slowest_len);
+  return s;
+}
 
-  uint32_t len; // valid if prim == Array
+// Fails if the current symbol has too many nodes. Nodes are still
+// allocated so that callers need not check errors, but the parser
+// stops because fail() discards the rest of the input.
+void Demangler::add_node() {
+  if (++num_nodes > limits.max_nodes)
+    fail(TooManyNodes, input);
+}
 
-  // Valid if prim is one of (Struct, Union, Class, Enum).
-  Name *name = nullptr;
+// If the arena is out of memory, the following functions fail and
+// return scratch nodes, just as validate() does.
+Name *Demangler::new_name() {
+  add_node();
+  if (validating)
+    return &scratch_name;
+  STAT(st.name_nodes++);
+  if (Name *n = new (arena) Name)
+    return n;
+  fail(OutOfMemory, input);
+  return &scratch_name;
+}
 
-  // Function parameters.
-  Type *params = nullptr;
+Type *Demangler::new_type() {
+  add_node();
+  if (validating)
+    return &scratch_type;
+  STAT(st.type_nodes++);
+  if (Type *t = new (arena) Type)
+    return t;
+  fail(OutOfMemory, input);
+  return &scratch_type;
+}
 
-  // Lists of types (e.g. function parameters) are represented as linked lists.
-  Type *next = nullptr;
-};
+void Demangler::reset(String s) {
+  type = Type();
+  symbol = nullptr;
+  resumable = false;
+
+  if (incremental && !name_cache) {
+    // Keep the checkpoints covered by the bytes that s has in common
+    // with the previous symbol, which is still in mangled. Those bytes
+    // are not copied again. The parser may have peeked at the byte
+    // following a checkpoint, e.g. to see if an operator name is
+    // followed by an identifier, so that byte must be the same too.
+    size_t n = 0;
+    if (num_ckpts && s.len <= inbuf.size()) {
+      size_t last = ckpts[num_ckpts - 1].len;
+      size_t end = std::min({s.len, mangled.len, last + 1});
+      size_t i = 0;
+      while (i < end && inbuf[i] == s.p[i])
+        ++i;
+      while (n < num_ckpts && ckpts[n].len < i)
+        ++n;
+    }
+    num_ckpts = n;
 
-// Demangler class takes the main role in demangling symbols.
-// It has a set of functions to parse mangled symbols into Type instnaces.
-// It also has a set of functions to cnovert Type instances to strings.
-class Demangler {
-public:
-  Demangler(String s) : input(s) {}
-
-  // You are supposed to call parse() first and then check if error is
-  // still empty. After that, call str() to get a result.
-  void parse();
-  std::string str();
-
-  // Error string. Empty if there's no error.
-  std::string error;
-
-private:
-  // Parser functions. This is a recursive-descendent parser.
-  void read_var_type(Type &ty);
-  void read_member_func_type(Type &ty);
-
-  int read_number();
-  String read_string(bool memorize);
-  void memorize_string(String s);
-  Name *read_name();
-  void read_func_ptr(Type &ty);
-  void read_operator(Name *);
-  String read_operator_name();
-  String read_until(const std::string &s);
-  PrimTy read_prim_type();
-  int read_func_class();
-  int8_t read_func_access_class();
-  CallingConv read_calling_conv();
-  void read_func_return_type(Type &ty);
-  int8_t read_storage_class();
-  int8_t read_storage_class_for_return();
-
-  void read_class(Type &ty, PrimTy prim);
-  void read_pointee(Type &ty, PrimTy prim);
-  void read_array(Type &ty);
-  Type *read_params();
-
-  int peek() { return (input.len == 0) ? -1 : input.p[0]; }
-
-  bool consume(const std::string &s) {
-    if (!input.startswith(s))
-      return false;
-    input.trim(s.size());
-    return true;
-  }
-
-  void expect(const std::string &s) {
-    if (!consume(s) && error.empty())
-      error = s + " expected, but got " + input.str();
-  }
-
-  // Mangled symbol. read_* functions shorten this string
-  // as they parse it.
-  String input;
-
-  // A parsed mangled symbol.
-  Type type;
-
-  // The main symbol name. (e.g. "ns::foo" in "int ns::foo()".)
-  Name *symbol = nullptr;
-
-  // Memory allocator.
-  Arena arena;
-
-  // The first 10 names in a mangled name can be back-referenced by
-  // special name @[0-9]. This is a storage for the first 10 names.
-  String names[10];
-  size_t num_names = 0;
-
-  // Functions to convert Type to String.
-  void write_pre(Type &ty);
-  void write_post(Type &ty);
-  void write_class(Name *name, String s);
-  void write_params(Type *ty);
-  void write_name(Name *name);
-  void write_tmpl_params(Name *name);
-  void write_operator(Name *name);
-  void write_space();
-
-  // The result is written to this stream.
-  std::stringstream os;
-};
-} // namespace
+    size_t len = 0;
+    if (n) {
+      resumable = true;
+      len = ckpts[n - 1].len;
+      arena.rewind(ckpts[n - 1].mark);
+    } else {
+      arena.reset();
+      if (inbuf.size() < s.len)
+        inbuf.resize(std::max(s.len, inbuf.size() * 2));
+    }
+    // inbuf.data() may be null if s and inbuf are empty.
+    if (s.len > len)
+      memcpy(inbuf.data() + len, s.p + len, s.len - len);
+    s = String(inbuf.data(), s.len);
+  } else {
+    arena.reset();
+  }
+
+  input = s;
+  num_names = 0;
+  depth = 0;
+  num_nodes = 0;
+  error = NoError;
+  error_pos = 0;
+  mangled = s;
+  os.clear();
+  if (name_cache)
+    name_cache->release();
+}
+
+std::string Demangler::error_message() const {
+  std::string rest = mangled.substr(error_pos).str();
+
+  switch (error) {
+  case NoError: return "";
+  case BadNumber: return "bad number: " + rest;
+  case MissingAt: return "read_string: missing '@': " + rest;
+  case BadNameRef: return "name reference too large: " + rest;
+  case UnknownOperator: return "unknown operator name: " + rest;
+  case UnknownFuncClass: return "unknown func class: " + rest;
+  case UnknownCallingConv: return "unknown calling convention: " + rest;
+  case UnknownStorageClass: return "unknown storage class: " + rest;
+  case UnknownPrimType: return "unknown primitive type: " + rest;
+  case BadArrayDimension: return "invalid array dimension: " + rest;
+  case BadBackref: return "invalid backreference: " + rest;
+  case Expected: return expected.str() + " expected, but got " + rest;
+  case TooDeep: return "nesting too deep: " + rest;
+  case TooManyNodes: return "too many nodes: " + rest;
+  case TooLong: return "demangled name too long";
+  case OutOfMemory: return "out of memory: " + rest;
+  }
+  return "";
+}
 
 // Parser entry point.
 void Demangler::parse() {
+#ifdef DEMANGLE_TRACE
+  tr.symbols++;
+#endif
+#ifdef DEMANGLE_STATS
+  TimerScope timer(st.parse_ns);
+  st.symbols++;
+  parse_symbol();
+  uint64_t ns = timer.elapsed();
+  if (ns > st.slowest_ns) {
+    st.slowest_ns = ns;
+    slowest_len = std::min(mangled.len, SlowestSize);
+    if (slowest_len)
+      memcpy(slowest, mangled.p, slowest_len);
+  }
+#else
+  parse_symbol();
+#endif
+}
+
+bool Demangler::validate(String s, SymbolInfo &info) {
+  reset(s);
+  validating = true;
+  parse_symbol();
+  validating = false;
+
+  info = SymbolInfo();
+  if (!error && type.prim != Unknown) {
+    if (type.prim != Function) {
+      info.kind = Variable;
+    } else if (type.func_class & (Public | Protected | Private)) {
+      info.kind = MemberFunction;
+      info.func_class = type.func_class;
+    } else {
+      // 'Y' and 'Z' functions have Global, and the former is read
+      // without setting func_class.
+      info.kind = FreeFunction;
+      info.func_class = type.func_class | Global;
+    }
+    if (type.prim == Function)
+      info.calling_conv = type.calling_conv;
+  }
+
+  // The AST refers to scratch nodes, which may form cycles.
+  type = Type();
+  symbol = nullptr;
+  return !error;
+}
+
+void Demangler::parse_symbol() {
   // MSVC-style mangled symbols must start with '?'.
   if (!consume("?")) {
-    symbol = new (arena) Name;
-    symbol->str = input;
+    symbol = new_name();
+    symbol->set_str(input);
     type.prim = Unknown;
+    return;
   }
 
   // What follows is a main symbol name. This may include
   // namespaces or class names.
-  symbol = read_name();
+  checkpointing = incremental && !name_cache && !validating;
+  symbol = resumable ? read_name_elems(resume()) : read_name();
+  if (error || ((flags & NameOnly) && !validating))
+    return;
 
   // Read a variable.
   if (consume("3")) {
     read_var_type(type);
+    read_var_storage_class();
     return;
   }
 
@@ -343,10 +541,13 @@ void Demangler::parse() {
   if (consume("Y")) {
     type.prim = Function;
     type.calling_conv = read_calling_conv();
-    type.ptr = new (arena) Type;
+    if (error)
+      return;
+    type.ptr = new_type();
     type.ptr->sclass = read_storage_class_for_return();
     read_var_type(*type.ptr);
     type.params = read_params();
+    read_params_end();
     return;
   }
 
@@ -356,11 +557,36 @@ void Demangler::parse() {
   expect("E"); // if 64 bit
   type.sclass = read_func_access_class();
   type.calling_conv = read_calling_conv();
+  if (error)
+    return;
 
-  type.ptr = new (arena) Type;
+  type.ptr = new_type();
   type.ptr->sclass = read_storage_class_for_return();
   read_func_return_type(*type.ptr);
   type.params = read_params();
+  read_params_end();
+}
+
+// Saves the state after reading a component of a symbol name in
+// incremental mode. The parser looks at most one byte ahead of what it
+// has consumed, so the state is the same for any symbol that starts
+// with the same bytes up to and including that byte.
+void Demangler::save_checkpoint(Name *head) {
+  if (num_ckpts == sizeof(ckpts) / sizeof(*ckpts))
+    return;
+  ckpts[num_ckpts++] = {mangled.len - input.len, head, num_names, num_nodes,
+                        arena.mark()};
+}
+
+// Restores the last checkpoint kept by reset() and returns the name
+// components read so far.
+Name *Demangler::resume() {
+  resumable = false;
+  const Checkpoint &c = ckpts[num_ckpts - 1];
+  input = mangled.substr(c.len);
+  num_names = c.num_names;
+  num_nodes = c.num_nodes;
+  return c.head;
 }
 
 // Sometimes numbers are encoded in mangled symbols. For example,
@@ -383,41 +609,34 @@ int Demangler::read_number() {
     return neg ? -ret : ret;
   }
 
-  int ret = 0;
-  for (size_t i = 0; i < input.len; ++i) {
-    char c = input.p[i];
-    if (c == '@') {
-      input.trim(i + 1);
-      return neg ? -ret : ret;
-    }
-    if ('A' <= c && c <= 'P') {
-      ret = (ret << 4) + (c - 'A');
-      continue;
-    }
-    break;
+  // Valid numbers have at most 8 hex digits. Longer ones would
+  // overflow.
+  size_t n = count_hex_digits(input.p, input.len);
+  if (n <= 8 && n < input.len && input.p[n] == '@') {
+    uint32_t ret = 0;
+    for (size_t i = 0; i < n; ++i)
+      ret = (ret << 4) + (input.p[i] - 'A');
+    input.trim(n + 1);
+    return (int)(neg ? 0 - ret : ret);
   }
 
-  if (error.empty())
-    error = "bad number: " + input.str();
+  fail(BadNumber, input);
   return 0;
 }
 
 // Read until the next '@'.
 String Demangler::read_string(bool memorize) {
-  for (size_t i = 0; i < input.len; ++i) {
-    if (input.p[i] != '@')
-      continue;
-    String ret = input.substr(0, i);
-    input.trim(i + 1);
-
-    if (memorize)
-      memorize_string(ret);
-    return ret;
+  size_t i = find_at(input.p, input.len);
+  if (i == input.len) {
+    fail(MissingAt, input);
+    return "";
   }
 
-  if (error.empty())
-    error = "read_string: missing '@': " + input.str();
-  return "";
+  String ret = input.substr(0, i);
+  input.trim(i + 1);
+  if (memorize)
+    memorize_string(ret);
+  return ret;
 }
 
 // First 10 strings can be referenced by special names ?0, ?1, ..., ?9.
@@ -425,31 +644,61 @@ String Demangler::read_string(bool memorize) {
 void Demangler::memorize_string(String s) {
   if (num_names >= sizeof(names) / sizeof(*names))
     return;
-  for (size_t i = 0; i < num_names; ++i)
-    if (s == names[i])
+  for (size_t i = 0; i < num_names; ++i) {
+    if (s == names[i]) {
+      min_name_ref = std::min(min_name_ref, i);
       return;
+    }
+  }
   names[num_names++] = s;
 }
 
 // Parses a name in the form of A@B@C@@ which represents C::B::A.
 Name *Demangler::read_name() {
-  Name *head = nullptr;
+  TRACE_RULE(TraceReadName);
+  if (!name_cache || validating)
+    return read_name_elems();
 
-  while (!consume("@")) {
-    Name *elem = new (arena) Name;
+  if (Name *name = read_cached_name()) {
+    name_cache->st.hits++;
+    return name;
+  }
+  name_cache->st.misses++;
+
+  String orig = input;
+  size_t base = num_names;
+  size_t saved = min_name_ref;
+  min_name_ref = sizeof(names) / sizeof(*names);
+
+  Name *head = read_name_elems();
+  if (!error && min_name_ref >= base)
+    cache_name(orig.substr(0, orig.len - input.len), base, head);
+  min_name_ref = std::min(saved, min_name_ref);
+  return head;
+}
+
+Name *Demangler::read_name_elems(Name *head) {
+  // Only components of the symbol name are checkpointed, not names
+  // in template arguments.
+  bool save = checkpointing;
+  checkpointing = false;
+
+  while (!error && !consume("@")) {
+    Name *elem = new_name();
 
     if (input.startswith_digit()) {
       size_t i = input.p[0] - '0';
       if (i >= num_names) {
-        if (error.empty())
-          error = "name reference too large: " + input.str();
+        fail(BadNameRef, input);
         return {};
       }
       input.trim(1);
-      elem->str = names[i];
+      elem->set_str(names[i]);
+      STAT(st.name_backrefs++);
+      min_name_ref = std::min(min_name_ref, i);
     } else if (consume("?$")) {
       // Class template.
-      elem->str = read_string(false);
+      elem->set_str(read_string(false));
       elem->params = read_params();
       expect("@");
     } else if (consume("?")) {
@@ -457,157 +706,211 @@ Name *Demangler::read_name() {
       read_operator(elem);
     } else {
       // Non-template functions or classes.
-      elem->str = read_string(true);
+      elem->set_str(read_string(true));
     }
 
     elem->next = head;
     head = elem;
+    if (save && !error)
+      save_checkpoint(head);
   }
 
   return head;
 }
 
+// If the input starts with a name in the name cache, consumes it and
+// returns a Name holding its rendered text. Otherwise returns null.
+Name *Demangler::read_cached_name() {
+  // A name starting with a backreference depends on preceding names,
+  // and names starting with operators are never cached.
+  if (input.startswith_digit() ||
+      (input.startswith('?') && !input.startswith("?$")))
+    return nullptr;
+
+  const NameCache::Entry *e = name_cache->find(input, num_names);
+  if (!e)
+    return nullptr;
+
+  // If a name to be memorized equals a preceding one, memorize_string()
+  // would skip it, and the indices of the following names would not be
+  // the same as when the entry was created.
+  size_t base = num_names;
+  for (const std::pair<uint32_t, uint32_t> &r : e->names) {
+    String s(input.p + r.first, r.second);
+    for (size_t i = 0; i < base; ++i)
+      if (s == names[i])
+        return nullptr;
+  }
+
+  for (const std::pair<uint32_t, uint32_t> &r : e->names)
+    names[num_names++] = String(input.p + r.first, r.second);
+  input.trim(e->mangled.size());
+
+  Name *name = new_name();
+  name->set_str(e->text);
+  return name;
+}
+
+// Adds a name that has just been read to the name cache. Only names
+// with template arguments are cached because others are cheap to
+// parse and print.
+void Demangler::cache_name(String mangled, size_t base, Name *name) {
+  // Names are rendered into os, so it must be unused.
+  if (!os.empty())
+    return;
+
+  bool has_tmpl = false;
+  for (Name *n = name; n; n = n->next) {
+    if (n->op)
+      return;
+    has_tmpl |= (n->params != nullptr);
+  }
+  if (!has_tmpl)
+    return;
+
+  std::unique_ptr<NameCache::Entry> e(new NameCache::Entry);
+  e->mangled = mangled.str();
+  e->base = base;
+  for (size_t i = base; i < num_names; ++i)
+    e->names.emplace_back(names[i].p - mangled.p, names[i].len);
+
+  // The name may fail to render if it is too long.
+  write_name(name);
+  e->text = os.str();
+  os.clear();
+  if (!error)
+    name_cache->insert(std::move(e));
+}
+
+uint64_t NameCache::key(String input, size_t base) {
+  size_t len = find_at(input.p, input.len);
+  return String(input.p, len).hash() + base * 0x9e3779b97f4a7c15;
+}
+
+const NameCache::Entry *NameCache::find(String input, size_t base) {
+  auto it = buckets.find(key(input, base));
+  if (it == buckets.end())
+    return nullptr;
+
+  // The parser consumes input from left to right without looking ahead
+  // past the end of a name, so a cached name that is a prefix of the
+  // input is read in exactly the same way as when it was cached.
+  for (const std::unique_ptr<Entry> &e : it->second)
+    if (e->base == base && input.startswith(e->mangled))
+      return e.get();
+  return nullptr;
+}
+
+void NameCache::insert(std::unique_ptr<Entry> e) {
+  std::vector<std::unique_ptr<Entry>> &v = buckets[key(e->mangled, e->base)];
+  if (v.size() >= bucket_size) {
+    st.entries--;
+    st.bytes -= v[0]->size();
+    evicted.push_back(std::move(v[0]));
+    v.erase(v.begin());
+  }
+  st.entries++;
+  st.bytes += e->size();
+  v.push_back(std::move(e));
+}
+
+void NameCache::release() {
+  evicted.clear();
+  if (st.bytes <= max_bytes)
+    return;
+  buckets.clear();
+  st.entries = 0;
+  st.bytes = 0;
+  st.flushes++;
+}
+
 void Demangler::read_func_ptr(Type &ty) {
-  Type *tp = new (arena) Type;
+  TRACE_RULE(TraceReadFuncPtr);
+  Type *tp = new_type();
   tp->prim = Function;
-  tp->ptr = new (arena) Type;
+  tp->ptr = new_type();
   read_var_type(*tp->ptr);
   tp->params = read_params();
 
   ty.prim = Ptr;
   ty.ptr = tp;
+  read_params_end();
+}
 
+// Consumes the end of a function parameter list and the throw
+// specification, which are not demangled.
+void Demangler::read_params_end() {
   if (input.startswith("@Z"))
     input.trim(2);
   else if (input.startswith("Z"))
     input.trim(1);
 }
 
+// Consumes the storage class at the end of a variable, which is not
+// demangled, so that consumed() covers the whole symbol.
+void Demangler::read_var_storage_class() {
+  consume("E"); // if 64 bit
+  read_storage_class();
+}
+
 void Demangler::read_operator(Name *name) {
-  name->op = read_operator_name();
-  if (error.empty() && peek() != '@')
-    name->str = read_string(true);
+  TRACE_RULE(TraceReadOperator);
+  name->op = read_operator_code();
+  if (!error && peek() != '@')
+    name->set_str(read_string(true));
 }
 
-String Demangler::read_operator_name() {
+// Returns a value for Name::op.
+uint8_t Demangler::read_operator_code() {
   String orig = input;
 
-  switch (input.get()) {
-  case '0': return "ctor";
-  case '1': return "dtor";
-  case '2': return " new";
-  case '3': return " delete";
-  case '4': return "=";
-  case '5': return ">>";
-  case '6': return "<<";
-  case '7': return "!";
-  case '8': return "==";
-  case '9': return "!=";
-  case 'A': return "[]";
-  case 'C': return "->";
-  case 'D': return "*";
-  case 'E': return "++";
-  case 'F': return "--";
-  case 'G': return "-";
-  case 'H': return "+";
-  case 'I': return "&";
-  case 'J': return "->*";
-  case 'K': return "/";
-  case 'L': return "%";
-  case 'M': return "<";
-  case 'N': return "<=";
-  case 'O': return ">";
-  case 'P': return ">=";
-  case 'Q': return ",";
-  case 'R': return "()";
-  case 'S': return "~";
-  case 'T': return "^";
-  case 'U': return "|";
-  case 'V': return "&&";
-  case 'W': return "||";
-  case 'X': return "*=";
-  case 'Y': return "+=";
-  case 'Z': return "-=";
-  case '_':
-    switch (input.get()) {
-    case '0': return "/=";
-    case '1': return "%=";
-    case '2': return ">>=";
-    case '3': return "<<=";
-    case '4': return "&=";
-    case '5': return "|=";
-    case '6': return "^=";
-    case 'U': return " new[]";
-    case 'V': return " delete[]";
-    case '_':
-      if (consume("L"))
-        return " co_await";
-    }
+  int c = input.get();
+  if (c != '_') {
+    if (operators[c].valid)
+      return c;
+  } else {
+    // "__L" is the only operator code longer than two bytes.
+    c = input.get();
+    if (operators_ext[c].valid && (c != '_' || consume("L")))
+      return c | 0x80;
   }
 
-  if (error.empty())
-    error = "unknown operator name: " + orig.str();
-  return "";
+  fail(UnknownOperator, orig);
+  return 0;
+}
+
+static String operator_name(uint8_t op) {
+  if (op & 0x80)
+    return operators_ext[op & 0x7f].value;
+  return operators[op].value;
 }
 
 int Demangler::read_func_class() {
-  switch (int c = input.get()) {
-  case 'A': return Private;
-  case 'B': return Private | FFar;
-  case 'C': return Private | Static;
-  case 'D': return Private | Static;
-  case 'E': return Private | Virtual;
-  case 'F': return Private | Virtual;
-  case 'I': return Protected;
-  case 'J': return Protected | FFar;
-  case 'K': return Protected | Static;
-  case 'L': return Protected | Static | FFar;
-  case 'M': return Protected | Virtual;
-  case 'N': return Protected | Virtual | FFar;
-  case 'Q': return Public;
-  case 'R': return Public | FFar;
-  case 'S': return Public | Static;
-  case 'T': return Public | Static | FFar;
-  case 'U': return Public | Virtual;
-  case 'V': return Public | Virtual | FFar;
-  case 'Y': return Global;
-  case 'Z': return Global | FFar;
-  default:
-    input.unget(c);
-    if (error.empty())
-      error = "unknown func class: " + input.str();
-    return 0;
-  }
+  int c = input.get();
+  if (func_classes[c].valid)
+    return func_classes[c].value;
+  input.unget(c);
+  fail(UnknownFuncClass, input);
+  return 0;
 }
 
 int8_t Demangler::read_func_access_class() {
-  switch (int c = input.get()) {
-  case 'A': return 0;
-  case 'B': return Const;
-  case 'C': return Volatile;
-  case 'D': return Const | Volatile;
-  default:
-    input.unget(c);
-    return 0;
-  }
+  int c = input.get();
+  if (access_classes[c].valid)
+    return access_classes[c].value;
+  input.unget(c);
+  return 0;
 }
 
 CallingConv Demangler::read_calling_conv() {
   String orig = input;
 
-  switch (input.get()) {
-  case 'A': return Cdecl;
-  case 'B': return Cdecl;
-  case 'C': return Pascal;
-  case 'E': return Thiscall;
-  case 'G': return Stdcall;
-  case 'I': return Fastcall;
-  default:
-    if (error.empty())
-      error = "unknown calling convention: " + orig.str();
-    return Cdecl;
-  }
-};
+  int c = input.get();
+  if (calling_convs[c].valid)
+    return calling_convs[c].value;
+  fail(UnknownCallingConv, orig);
+  return Cdecl;
+}
 
 // <return-type> ::= <type>
 //               ::= @ # structors (they have no declared return type)
@@ -619,19 +922,11 @@ void Demangler::read_func_return_type(Type &ty) {
 }
 
 int8_t Demangler::read_storage_class() {
-  switch (int c = input.get()) {
-  case 'A': return 0;
-  case 'B': return Const;
-  case 'C': return Volatile;
-  case 'D': return Const | Volatile;
-  case 'E': return Far;
-  case 'F': return Const | Far;
-  case 'G': return Volatile | Far;
-  case 'H': return Const | Volatile | Far;
-  default:
-    input.unget(c);
-    return 0;
-  }
+  int c = input.get();
+  if (storage_classes[c].valid)
+    return storage_classes[c].value;
+  input.unget(c);
+  return 0;
 }
 
 int8_t Demangler::read_storage_class_for_return() {
@@ -639,58 +934,78 @@ int8_t Demangler::read_storage_class_for_return() {
     return 0;
   String orig = input;
 
-  switch (input.get()) {
-  case 'A': return 0;
-  case 'B': return Const;
-  case 'C': return Volatile;
-  case 'D': return Const | Volatile;
-  default:
-    if (error.empty())
-      error = "unknown storage class: " + orig.str();
-    return 0;
-  }
+  // Return types take the same qualifiers as member functions.
+  int c = input.get();
+  if (access_classes[c].valid)
+    return access_classes[c].value;
+  fail(UnknownStorageClass, orig);
+  return 0;
 }
 
 // Reads a variable type.
 void Demangler::read_var_type(Type &ty) {
-  if (consume("W4")) {
-    ty.prim = Enum;
-    ty.name = read_name();
+  TRACE_RULE(TraceReadVarType);
+  if (depth == limits.max_depth) {
+    fail(TooDeep, input);
     return;
   }
 
-  if (consume("P6A")) {
-    read_func_ptr(ty);
-    return;
-  }
+  depth++;
+  STAT(st.max_parse_depth = std::max(st.max_parse_depth, depth));
+  read_var_type_chain(ty);
+  depth--;
+}
 
-  switch (int c = input.get()) {
-  case 'T':
-    read_class(ty, Union);
-    return;
-  case 'U':
-    read_class(ty, Struct);
-    return;
-  case 'V':
-    read_class(ty, Class);
-    return;
-  case 'A':
-    read_pointee(ty, Ref);
-    return;
-  case 'P':
-    read_pointee(ty, Ptr);
-    return;
-  case 'Q':
-    read_pointee(ty, Ptr);
-    ty.sclass = Const;
-    return;
-  case 'Y':
-    read_array(ty);
-    return;
-  default:
-    input.unget(c);
-    ty.prim = read_prim_type();
-    return;
+// Reads a variable type. Pointers and references are read in a loop
+// instead of by recursion, so a long chain of them does not exhaust
+// the stack.
+void Demangler::read_var_type_chain(Type &ty) {
+  for (Type *tp = &ty; !error; tp = tp->ptr) {
+    if (consume("W4")) {
+      tp->prim = Enum;
+      tp->name = read_name();
+      return;
+    }
+
+    if (consume("P6A")) {
+      read_func_ptr(*tp);
+      return;
+    }
+
+    int c = input.get();
+    switch (c) {
+    case 'T':
+      read_class(*tp, Union);
+      return;
+    case 'U':
+      read_class(*tp, Struct);
+      return;
+    case 'V':
+      read_class(*tp, Class);
+      return;
+    case 'A':
+      tp->prim = Ref;
+      break;
+    case 'P':
+      tp->prim = Ptr;
+      break;
+    case 'Q':
+      tp->prim = Ptr;
+      tp->sclass = Const;
+      break;
+    case 'Y':
+      read_array(*tp);
+      return;
+    default:
+      input.unget(c);
+      tp->prim = read_prim_type();
+      return;
+    }
+
+    // Read the pointee type in the next iteration.
+    expect("E"); // if 64 bit
+    tp->ptr = new_type();
+    tp->ptr->sclass = read_storage_class();
   }
 }
 
@@ -698,31 +1013,12 @@ void Demangler::read_var_type(Type &ty) {
 PrimTy Demangler::read_prim_type() {
   String orig = input;
 
-  switch (input.get()) {
-  case 'X': return Void;
-  case 'D': return Char;
-  case 'C': return Schar;
-  case 'E': return Uchar;
-  case 'F': return Short;
-  case 'G': return Ushort;
-  case 'H': return Int;
-  case 'I': return Uint;
-  case 'J': return Long;
-  case 'K': return Ulong;
-  case 'M': return Float;
-  case 'N': return Double;
-  case 'O': return Ldouble;
-  case '_':
-    switch (input.get()) {
-    case 'N': return Bool;
-    case 'J': return Int64;
-    case 'K': return Uint64;
-    case 'W': return Wchar;
-    }
-  }
-
-  if (error.empty())
-    error = "unknown primitive type: " + orig.str();
+  int c = input.get();
+  const ByteTable<PrimTy>::Entry &e =
+      (c == '_') ? prim_types_ext[input.get()] : prim_types[c];
+  if (e.valid)
+    return e.value;
+  fail(UnknownPrimType, orig);
   return Unknown;
 }
 
@@ -731,37 +1027,32 @@ void Demangler::read_class(Type &ty, PrimTy prim) {
   ty.name = read_name();
 }
 
-void Demangler::read_pointee(Type &ty, PrimTy prim) {
-  ty.prim = prim;
-  expect("E"); // if 64 bit
-  ty.ptr = new (arena) Type;
-  ty.ptr->sclass = read_storage_class();
-  read_var_type(*ty.ptr);
-}
-
 void Demangler::read_array(Type &ty) {
+  TRACE_RULE(TraceReadArray);
+  String orig = input;
   int dimension = read_number();
   if (dimension <= 0) {
-    if (error.empty())
-      error = "invalid array dimension: " + std::to_string(dimension);
+    fail(BadArrayDimension, orig);
     return;
   }
 
   Type *tp = &ty;
-  for (int i = 0; i < dimension; ++i) {
+  for (int i = 0; i < dimension && !error; ++i) {
     tp->prim = Array;
     tp->len = read_number();
-    tp->ptr = new (arena) Type;
+    tp->ptr = new_type();
     tp = tp->ptr;
   }
+  if (error)
+    return;
 
   if (consume("$$C")) {
     if (consume("B"))
       ty.sclass = Const;
     else if (consume("C") || consume("D"))
       ty.sclass = Const | Volatile;
-    else if (!consume("A") && error.empty())
-      error = "unkonwn storage class: " + input.str();
+    else if (!consume("A"))
+      fail(UnknownStorageClass, input);
   }
 
   read_var_type(*tp);
@@ -769,38 +1060,47 @@ void Demangler::read_array(Type &ty) {
 
 // Reads a function or a template parameters.
 Type * Demangler::read_params() {
+  TRACE_RULE(TraceReadParams);
+
   // Within the same parameter list, you can backreference the first 10 types.
   Type *backref[10];
   int idx = 0;
 
   Type *head = nullptr;
   Type **tp = &head;
-  while (error.empty() && !input.startswith('@') && !input.startswith('Z')) {
+  while (!error && !input.startswith('@') && !input.startswith('Z')) {
     if (input.startswith_digit()) {
       int n = input.p[0] - '0';
       if (n >= idx) {
-        if (error.empty())
-          error = "invalid backreference: " + input.str();
+        fail(BadBackref, input);
         return nullptr;
       }
       input.trim(1);
 
-      *tp = new (arena) Type(*backref[n]);
-      (*tp)->next = nullptr;
-      tp = &(*tp)->next;
+      // The referenced subtree is not copied. write_params() copies
+      // the text it wrote for it instead.
+      Type *t = new_type();
+      STAT(st.param_backrefs++);
+      t->prim = Backref;
+      t->ptr = backref[n];
+      *tp = t;
+      tp = &t->next;
       continue;
     }
 
     size_t len = input.len;
 
-    *tp = new (arena) Type;
-    read_var_type(**tp);
+    // Nodes are not read back through tp because validate() makes all
+    // nodes the same object, which read_var_type() overwrites.
+    Type *t = new_type();
+    *tp = t;
+    read_var_type(*t);
 
     // Single-letter types are ignored for backreferences because
     // memorizing them doesn't save anything.
     if (idx <= 9 && len - input.len > 1)
-      backref[idx++] = *tp;
-    tp = &(*tp)->next;
+      backref[idx++] = t;
+    tp = &t->next;
   }
   return head;
 }
@@ -822,175 +1122,259 @@ Type * Demangler::read_params() {
 // the "first half" of type declaration, and write_post() writes the
 // "second half". For example, write_pre() writes a return type for a
 // function and write_post() writes an parameter list.
-std::string Demangler::str() {
-  write_pre(type);
-  write_name(symbol);
-  write_post(type);
-  return os.str();
+void Demangler::render() {
+  STAT_TIMER(st.render_ns);
+  os.clear();
+  if (flags & NameOnly) {
+    write_name(symbol);
+  } else {
+    bool func = (type.prim == Function);
+    if (!func || !(flags & NoReturnType))
+      write_pre(type);
+    write_name(symbol);
+    if (!func || !(flags & NoParams))
+      write_post(type);
+  }
+
+  // write_params() checks the limit only between parameters to stop
+  // exponential growth early, so check the whole result here.
+  if (os.size() > limits.max_output)
+    fail(TooLong, mangled.substr(mangled.len));
+}
+
+String Demangler::view() {
+  render();
+  return os.view();
 }
 
+void Demangler::write(Sink &sink) {
+  os.set_sink(&sink);
+  render();
+  os.set_sink(nullptr);
+  os.clear();
+}
+
+std::string Demangler::str() { return view().str(); }
+
 // Write the "first half" of a given type.
+//
+// A pointer or a reference is written after the type it points to.
+// Chains of them are walked without recursion, because read_var_type()
+// accepts chains of any length, and without a stack, so that rendering
+// does not allocate memory. Instead, the links of a chain are reversed
+// to walk it backwards and are restored on the way.
 void Demangler::write_pre(Type &ty) {
-  switch (ty.prim) {
-  case Unknown:
-  case None:
-    break;
-  case Function:
-    write_pre(*ty.ptr);
+  TRACE_RULE(TraceWritePre);
+  STAT_DEPTH(write_depth, st.max_write_depth);
+
+  if (ty.prim != Ptr && ty.prim != Ref) {
+    write_pre_base(ty);
     return;
-  case Ptr:
-  case Ref:
-    write_pre(*ty.ptr);
+  }
+
+  Type *base = &ty;
+  while (base->prim == Ptr || base->prim == Ref)
+    base = base->ptr;
+  write_pre_base(*base);
+
+  Type *last = nullptr;
+  for (Type *tp = &ty; tp != base;) {
+    Type *next = tp->ptr;
+    tp->ptr = last;
+    last = tp;
+    tp = next;
+  }
+
+  Type *pointee = base;
+  while (last) {
+    Type &p = *last;
+    last = p.ptr;
+    p.ptr = pointee;
+    pointee = &p;
 
     // "[]" and "()" (for function parameters) take precedence over "*",
     // so "int *x(int)" means "x is a function returning int *". We need
     // parentheses to supercede the default precedence. (e.g. we want to
     // emit something like "int (*x)(int)".)
-    if (ty.ptr->prim == Function || ty.ptr->prim == Array)
-      os << "(";
+    if (p.ptr->prim == Function || p.ptr->prim == Array)
+      os.write(Punct, "(");
 
-    if (ty.prim == Ptr)
-      os << "*";
-    else
-      os << "&";
-    break;
+    os.write(Punct, (p.prim == Ptr) ? String("*") : String("&"));
+
+    if (p.sclass & Const) {
+      write_space();
+      os.write(Keyword, "const");
+    }
+  }
+}
+
+// Write the "first half" of a type other than a pointer or a reference.
+void Demangler::write_pre_base(Type &ty) {
+  switch (ty.prim) {
+  case Function:
+    write_pre(*ty.ptr);
+    return;
+  case Ptr:
+  case Ref:
+    // Handled by write_pre().
+    return;
   case Array:
     write_pre(*ty.ptr);
     break;
-
-  case Struct: write_class(ty.name, "struct"); break;
-  case Union:  write_class(ty.name, "union"); break;
-  case Class:  write_class(ty.name, "class"); break;
-  case Enum:   write_class(ty.name, "enum"); break;
-  case Void:    os << "void"; break;
-  case Bool:    os << "bool"; break;
-  case Char:    os << "char"; break;
-  case Schar:   os << "signed char"; break;
-  case Uchar:   os << "unsigned char"; break;
-  case Short:   os << "short"; break;
-  case Ushort:  os << "unsigned short"; break;
-  case Int:     os << "int"; break;
-  case Uint:    os << "unsigned int"; break;
-  case Long:    os << "long"; break;
-  case Ulong:   os << "unsigned long"; break;
-  case Int64:   os << "int64_t"; break;
-  case Uint64:  os << "uint64_t"; break;
-  case Wchar:   os << "wchar_t"; break;
-  case Float:   os << "float"; break;
-  case Double:  os << "double"; break;
-  case Ldouble: os << "long double"; break;
+  case Struct:
+  case Union:
+  case Class:
+  case Enum:
+    write_class(ty.name, prim_names[ty.prim]);
+    break;
+  default:
+    // Primitive types. prim_names[] has empty strings for Unknown and
+    // None.
+    os.write(Keyword, prim_names[ty.prim]);
+    break;
   }
 
   if (ty.sclass & Const) {
     write_space();
-    os << "const";
+    os.write(Keyword, "const");
   }
 }
 
 // Write the "second half" of a given type.
 void Demangler::write_post(Type &ty) {
-  if (ty.prim == Function) {
-    os << "(";
-    write_params(ty.params);
-    os << ")";
-    if (ty.sclass & Const)
-      os << "const";
-    return;
-  }
+  TRACE_RULE(TraceWritePost);
+  for (Type *tp = &ty;; tp = tp->ptr) {
+    if (tp->prim == Function) {
+      os.write(Punct, "(");
+      write_params(tp->params);
+      os.write(Punct, ")");
+      if ((tp->sclass & Const) && !(flags & NoQualifiers))
+        os.write(Keyword, "const");
+      return;
+    }
 
-  if (ty.prim == Ptr || ty.prim == Ref) {
-    if (ty.ptr->prim == Function || ty.ptr->prim == Array)
-      os << ")";
-    write_post(*ty.ptr);
-    return;
-  }
+    if (tp->prim == Ptr || tp->prim == Ref) {
+      if (tp->ptr->prim == Function || tp->ptr->prim == Array)
+        os.write(Punct, ")");
+      continue;
+    }
 
-  if (ty.prim == Array) {
-    os << "[" << ty.len << "]";
-    write_post(*ty.ptr);
+    if (tp->prim != Array)
+      return;
+    os.write(Punct, "[");
+    os.write(Number, tp->len);
+    os.write(Punct, "]");
   }
 }
 
 // Write a function or template parameter list.
 void Demangler::write_params(Type *params) {
+  TRACE_RULE(TraceWriteParams);
+
+  // Where the parameters that backreferences may refer to were written.
+  // Only the first 10 parameters can be referred to.
+  struct Written {
+    Type *ty;
+    size_t pos;
+    size_t len;
+  } written[10];
+  int nwritten = 0;
+
   for (Type *tp = params; tp; tp = tp->next) {
+    // Parameters referred to by backreferences are written more than
+    // once, so the output can grow exponentially with the input.
+    if (os.size() > limits.max_output) {
+      fail(TooLong, mangled.substr(mangled.len));
+      return;
+    }
+
     if (tp != params)
-      os << ",";
+      os.write(Punct, ",");
+
+    if (tp->prim == Backref) {
+      // A parameter follows '(', '<' or ',', so its text does not depend
+      // on where it is written, and we can copy the bytes instead of
+      // walking the same subtree again. A Sink needs tokens, though.
+      Type *ty = tp->ptr;
+      int i = 0;
+      while (i < nwritten && written[i].ty != ty)
+        ++i;
+      if (i < nwritten && !os.has_sink()) {
+        os.repeat(written[i].pos, written[i].len);
+      } else {
+        write_pre(*ty);
+        write_post(*ty);
+      }
+      continue;
+    }
+
+    size_t pos = os.size();
     write_pre(*tp);
     write_post(*tp);
+    if (nwritten < 10)
+      written[nwritten++] = {tp, pos, os.size() - pos};
   }
 }
 
 void Demangler::write_class(Name *name, String s) {
-  os << s << " ";
+  TRACE_RULE(TraceWriteClass);
+  os.write(Keyword, s);
+  os.write(Space, " ");
   write_name(name);
 }
 
 // Write a name read by read_name().
 void Demangler::write_name(Name *name) {
+  TRACE_RULE(TraceWriteName);
   if (!name)
     return;
   write_space();
 
   // Print out namespaces or outer class names.
   for (; name->next; name = name->next) {
-    os << name->str;
+    os.write(Identifier, name->str());
     write_tmpl_params(name);
-    os << "::";
+    os.write(Scope, "::");
   }
 
   // Print out a regular name.
-  if (name->op.empty()) {
-    os << name->str;
+  if (!name->op) {
+    os.write(Identifier, name->str());
     write_tmpl_params(name);
     return;
   }
 
   // Print out ctor or dtor.
-  if (name->op == "ctor" || name->op == "dtor") {
-    os << name->str;
+  if (name->op == '0' || name->op == '1') {
+    os.write(Identifier, name->str());
     write_params(name->params);
-    os << "::";
-    if (name->op == "dtor")
-      os << "~";
-    os << name->str;
+    os.write(Scope, "::");
+    if (name->op == '1')
+      os.write(Punct, "~");
+    os.write(Identifier, name->str());
     return;
   }
 
   // Print out an overloaded operator.
-  if (!name->str.empty())
-    os << name->str << "::";
-  os << "operator" << name->op;
+  if (name->str_len) {
+    os.write(Identifier, name->str());
+    os.write(Scope, "::");
+  }
+  os.write(Keyword, "operator");
+  os.write(Operator, operator_name(name->op));
 }
 
 void Demangler::write_tmpl_params(Name *name) {
-  if (!name->params)
+  TRACE_RULE(TraceWriteTmplParams);
+  if (!name->params || (flags & NoTemplateArgs))
     return;
-  os << "<";
+  os.write(Punct, "<");
   write_params(name->params);
-  os << ">";
+  os.write(Punct, ">");
 }
 
 // Writes a space if the last token does not end with a punctuation.
 void Demangler::write_space() {
-  std::string s = os.str();
-  if (!s.empty() && isalpha(s.back()))
-    os << " ";
-}
-
-int main(int argc, char **argv) {
-  if (argc != 2) {
-    std::cout << argv[0] << " <symbol>\n";
-    exit(1);
-  }
-
-  Demangler demangler({argv[1], strlen(argv[1])});
-  demangler.parse();
-  if (!demangler.error.empty()) {
-    std::cerr << demangler.error << "\n";
-    return 1;
-  }
-
-  std::cout << demangler.str() << '\n';
-  return 0;
+  if (!os.empty() && isalpha(os.back()))
+    os.write(Space, " ");
 }
@@ -0,0 +1,951 @@
+//===- MicrosoftDemangle.h --------------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares a demangler for MSVC-style mangled symbols.
+//
+// A Demangler instance can be reused for many symbols. Call reset()
+// with a new symbol, then parse() and view() (or str()). Memory
+// allocated for one symbol is recycled for the next one, so once an
+// instance is warmed up it demangles symbols without heap allocation.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MICROSOFT_DEMANGLE_H
+#define MICROSOFT_DEMANGLE_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ms_demangle {
+
+// This class provides a few utility functions for string manipulations.
+class String {
+public:
+  String() = default;
+  String(const String &) = default;
+  String(const std::string &s) : p(s.data()), len(s.size()) {}
+  explicit String(const char *p) : p(p), len(strlen(p)) {}
+  constexpr String(const char *p, size_t len) : p(p), len(len) {}
+
+  // String literals take this constructor, so their length is a
+  // compile-time constant. (The one above is explicit; otherwise it
+  // would win overload resolution and call strlen().)
+  template <size_t N>
+  constexpr String(const char (&p)[N]) : p(p), len(N - 1) {}
+
+  std::string str() const { return {p, p + len}; }
+
+  bool empty() const { return len == 0; }
+
+  bool startswith(char c) const { return len > 0 && *p == c; }
+
+  // Call sites usually pass string literals, whose lengths are known
+  // at compile time, so this compiles to a few byte comparisons.
+  bool startswith(String s) const {
+    return s.len <= len && memcmp(p, s.p, s.len) == 0;
+  }
+
+  bool startswith_digit() const {
+    return 0 < len && '0' <= p[0] && p[0] <= '9';
+  }
+
+  String substr(size_t off) const { return {p + off, len - off}; }
+  String substr(size_t off, size_t length) const { return {p + off, length}; }
+
+  bool operator==(const String s) const {
+    return len == s.len && memcmp(p, s.p, len) == 0;
+  }
+
+  // FNV-1a hash of the contents.
+  uint64_t hash() const {
+    uint64_t h = 0xcbf29ce484222325;
+    for (size_t i = 0; i < len; ++i)
+      h = (h ^ (uint8_t)p[i]) * 0x100000001b3;
+    return h;
+  }
+
+  void trim(size_t n) {
+    assert(n <= len);
+    p += n;
+    len -= n;
+  }
+
+  int get() {
+    if (len == 0)
+      return -1;
+    len--;
+    return *p++;
+  }
+
+  void unget(int c) {
+    if (c == -1)
+      return;
+    p--;
+    len++;
+  }
+
+  const char *p = nullptr;
+  size_t len = 0;
+};
+
+inline std::ostream &operator<<(std::ostream &os, const String s) {
+  os.write(s.p, s.len);
+  return os;
+}
+
+// Kinds of tokens in demangled names. See Sink.
+enum TokenKind : uint8_t {
+  Identifier, // e.g. "foo", or a whole name taken from a NameCache
+  Scope,      // "::"
+  Keyword,    // e.g. "int", "class", "const" or "operator"
+  Operator,   // What follows "operator", e.g. "+" or " new"
+  Number,     // An array dimension
+  Punct,      // e.g. "*", "(", "<" or ","
+  Space,      // " " between tokens
+};
+
+// An interface to receive a demangled name token by token instead of as
+// a string. See Demangler::write().
+class Sink {
+public:
+  virtual ~Sink() = default;
+  virtual void append(TokenKind kind, String s) = 0;
+};
+
+// A growable output buffer for the demangler. Unlike std::stringstream,
+// it knows its last character and can return its contents as a String
+// without copying them. clear() keeps the allocated memory, so the same
+// buffer can be reused for many symbols.
+//
+// If a Sink is set, tokens are passed to it instead of being stored,
+// and only their total length and last character are kept.
+class Output {
+public:
+  Output() = default;
+  Output(const Output &) = delete;
+  Output &operator=(const Output &) = delete;
+  ~Output() { delete[] buf; }
+
+  void write(TokenKind kind, String s) {
+    if (s.len == 0)
+      return;
+    last = s.p[s.len - 1];
+    if (sink) {
+      sink->append(kind, s);
+      len += s.len;
+      return;
+    }
+    reserve(s.len);
+    memcpy(buf + len, s.p, s.len);
+    len += s.len;
+  }
+
+  void write(TokenKind kind, uint32_t n) {
+    char tmp[10];
+    char *p = tmp + sizeof(tmp);
+    do {
+      *--p = '0' + n % 10;
+      n /= 10;
+    } while (n);
+    write(kind, String(p, tmp + sizeof(tmp) - p));
+  }
+
+  // Appends a copy of n bytes written at pos. It cannot be used if a
+  // Sink is set.
+  void repeat(size_t pos, size_t n) {
+    if (n == 0)
+      return;
+    reserve(n);
+    memcpy(buf + len, buf + pos, n);
+    len += n;
+    last = buf[len - 1];
+  }
+
+  void set_sink(Sink *s) { sink = s; }
+  bool has_sink() const { return sink; }
+
+  bool empty() const { return len == 0; }
+  char back() const { return last; }
+  size_t size() const { return len; }
+  void clear() { len = 0; }
+
+  // Returns the contents. The result is valid until the buffer is
+  // written to or cleared.
+  String view() const { return {buf, len}; }
+  std::string str() const { return {buf, buf + len}; }
+
+private:
+  void reserve(size_t n) {
+    if (len + n <= cap)
+      return;
+    cap = std::max(len + n, cap * 2);
+    char *p = new char[cap];
+    if (len)
+      memcpy(p, buf, len);
+    delete[] buf;
+    buf = p;
+  }
+
+  char *buf = nullptr;
+  size_t len = 0;
+  size_t cap = 0;
+  char last = 0;
+  Sink *sink = nullptr;
+};
+
+#ifndef DEMANGLE_ARENA_CHUNK_SIZE
+#define DEMANGLE_ARENA_CHUNK_SIZE 4096
+#endif
+
+// This memory allocator is extremely fast, but it doesn't call dtors
+// for allocated objects. That means you can't use STL containers
+// (such as std::vector) with this allocator. But it pays off --
+// the demangler is 3x faster with this allocator compared to one with
+// STL containers.
+//
+// Memory is carved out of chunks of chunk_size bytes. Objects larger
+// than half a chunk get blocks of their own. Chunks of the default size
+// are not freed when an Arena dies but kept in a per-thread free list,
+// from which Arenas created later on the same thread take their chunks.
+//
+// An Arena can also be given a buffer to use instead of the heap, in
+// which case alloc() returns null when the buffer is exhausted.
+class Arena {
+public:
+  static constexpr size_t default_chunk_size = DEMANGLE_ARENA_CHUNK_SIZE;
+
+  explicit Arena(size_t chunk_size = default_chunk_size)
+      : chunk_size(chunk_size) {}
+  Arena(void *buf, size_t size);
+  ~Arena();
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  // Returns size bytes aligned to align, which must be a power of two
+  // not greater than alignof(std::max_align_t).
+  void *alloc(size_t size, size_t align = alignof(std::max_align_t)) {
+#ifdef DEMANGLE_STATS
+    bytes_allocated += size;
+#endif
+    size_t off = (nused + align - 1) & ~(align - 1);
+    if (off + size <= cap) {
+      nused = off + size;
+      return buf + off;
+    }
+    return alloc_slow(size);
+  }
+
+  // Discards all objects allocated so far. Chunks are not freed but
+  // reused by subsequent alloc() calls. Large blocks are freed.
+  void reset() {
+    buf = fixed_buf;
+    nused = 0;
+    cap = fixed_size;
+    nchunks = 0;
+    if (!large.empty()) {
+      large.clear();
+      large_bytes = 0;
+    }
+  }
+
+  // A position in an Arena. rewind() discards objects allocated after
+  // mark() and keeps the ones allocated before.
+  struct Mark {
+    uint8_t *buf;
+    size_t nused;
+    size_t cap;
+    size_t nchunks;
+    size_t nlarge;
+    size_t large_bytes;
+  };
+
+  Mark mark() const {
+    return {buf, nused, cap, nchunks, large.size(), large_bytes};
+  }
+
+  void rewind(const Mark &m) {
+    buf = m.buf;
+    nused = m.nused;
+    cap = m.cap;
+    nchunks = m.nchunks;
+    large.resize(m.nlarge);
+    large_bytes = m.large_bytes;
+  }
+
+  // Returns the number of bytes allocated since the last reset(),
+  // including space wasted at the end of full chunks.
+  size_t used() const {
+    return (nchunks ? (nchunks - 1) * chunk_size : 0) + nused + large_bytes;
+  }
+
+  // Bytes returned by alloc() and chunks or large blocks obtained from
+  // the heap or the free list since this Arena was created. They are
+  // only updated if compiled with -DDEMANGLE_STATS, but always exist
+  // so that the layout does not depend on the flag.
+  size_t bytes_allocated = 0;
+  size_t chunks_allocated = 0;
+
+private:
+  void *alloc_slow(size_t size);
+  uint8_t *new_chunk();
+
+  const size_t chunk_size;
+
+  // The buffer given to the constructor, if any.
+  uint8_t *fixed_buf = nullptr;
+  size_t fixed_size = 0;
+
+  uint8_t *buf = nullptr;
+  size_t nused = 0;
+  size_t cap = 0;
+
+  // The number of chunks in `chunks` that are in use.
+  size_t nchunks = 0;
+  std::vector<std::unique_ptr<uint8_t[]>> chunks;
+  std::vector<std::unique_ptr<uint8_t[]>> large;
+  size_t large_bytes = 0;
+};
+} // namespace ms_demangle
+
+// This is noexcept so that new-expressions return null instead of
+// constructing objects if an Arena with a fixed buffer is exhausted.
+inline void *operator new(size_t size, ms_demangle::Arena &a) noexcept {
+  return a.alloc(size);
+}
+
+namespace ms_demangle {
+
+// Storage classes
+enum {
+  Const = 1 << 0,
+  Volatile = 1 << 1,
+  Far = 1 << 2,
+  Huge = 1 << 3,
+  Unaligned = 1 << 4,
+  Restrict = 1 << 5,
+};
+
+// Calling conventions
+enum CallingConv : uint8_t {
+  Cdecl,
+  Pascal,
+  Thiscall,
+  Stdcall,
+  Fastcall,
+  Regcall,
+};
+
+// Types
+enum PrimTy : uint8_t {
+  Unknown,
+  None,
+  Function,
+  Ptr,
+  Ref,
+  Array,
+  Backref, // A parameter that refers to an earlier one
+
+  Struct,
+  Union,
+  Class,
+  Enum,
+
+  Void,
+  Bool,
+  Char,
+  Schar,
+  Uchar,
+  Short,
+  Ushort,
+  Int,
+  Uint,
+  Long,
+  Ulong,
+  Int64,
+  Uint64,
+  Wchar,
+  Float,
+  Double,
+  Ldouble,
+};
+
+// Function classes
+enum FuncClass : uint8_t {
+  Public = 1 << 0,
+  Protected = 1 << 1,
+  Private = 1 << 2,
+  Global = 1 << 3,
+  Static = 1 << 4,
+  Virtual = 1 << 5,
+  FFar = 1 << 6,
+};
+
+// Grammar rules whose calls are counted and timed if the demangler is
+// compiled with -DDEMANGLE_TRACE. See Demangler::trace().
+enum TraceRule : uint8_t {
+  TraceReadName,
+  TraceReadVarType,
+  TraceReadParams,
+  TraceReadFuncPtr,
+  TraceReadArray,
+  TraceReadOperator,
+  TraceWritePre,
+  TraceWritePost,
+  TraceWriteParams,
+  TraceWriteName,
+  TraceWriteTmplParams,
+  TraceWriteClass,
+  NumTraceRules,
+};
+
+// Kinds of symbols, as returned by Demangler::validate().
+enum SymbolKind : uint8_t {
+  NotMangled,
+  Variable,
+  FreeFunction,
+  MemberFunction,
+};
+
+// Flags for Demangler::set_flags() to omit parts of demangled names,
+// like UNDNAME_* flags of Microsoft's undname. Calling conventions and
+// access specifiers are never written, so there are no flags for them.
+enum RenderFlags : uint8_t {
+  NoReturnType = 1 << 0,   // The return type of a function
+  NoParams = 1 << 1,       // The parameter list of a function
+  NoTemplateArgs = 1 << 2, // Template arguments of all names
+  NoQualifiers = 1 << 3,   // "const" of a member function
+  // Only the qualified name of a symbol. parse() stops after reading it,
+  // so errors in the rest of the symbol are not found.
+  NameOnly = 1 << 4,
+};
+
+struct Type;
+
+// Represents an identifier which may be a template.
+//
+// Fields of Name and Type are ordered and packed so that each of them
+// takes 32 bytes on 64-bit hosts. A symbol has dozens of these nodes.
+struct Name {
+  // Name read from an input string. The length is 32-bit to keep this
+  // struct small.
+  String str() const { return {str_p, str_len}; }
+  void set_str(String s) {
+    str_p = s.p;
+    str_len = s.len;
+  }
+
+  const char *str_p = nullptr;
+  uint32_t str_len = 0;
+
+  // Overloaded operators are represented as special names in mangled symbols.
+  // If this is an operator name, "op" has the byte following "?" in the
+  // mangled name (e.g. '5' for ">>"), or the byte following "?_" with
+  // the high bit set. Otherwise, 0.
+  uint8_t op = 0;
+
+  // Template parameters. Null if not a template.
+  Type *params = nullptr;
+
+  // Nested names (e.g. "A::B::C") are represented as a linked list.
+  Name *next = nullptr;
+};
+
+// The type class. Mangled symbols are first parsed and converted to
+// this type and then converted to string.
+struct Type {
+  // Primitive type such as Int.
+  PrimTy prim;
+
+  uint8_t sclass = 0;  // storage class
+  CallingConv calling_conv;
+  FuncClass func_class;
+
+  uint32_t len; // valid if prim == Array
+
+  // Represents a type X in "a pointer to X", "a reference to X",
+  // "an array of X", or "a function returning X". If prim is Backref,
+  // the parameter this node refers to.
+  Type *ptr = nullptr;
+
+  union {
+    // Valid if prim is one of (Struct, Union, Class, Enum).
+    Name *name = nullptr;
+
+    // Function parameters. Valid if prim == Function.
+    Type *params;
+  };
+
+  // Lists of types (e.g. function parameters) are represented as linked lists.
+  Type *next = nullptr;
+};
+
+// Error codes. The parser records the first error it finds as a code
+// and an input offset. Demangler::error_message() turns them into a
+// human-readable message only when someone asks for it.
+enum ErrorCode : uint8_t {
+  NoError,
+  BadNumber,
+  MissingAt,
+  BadNameRef,
+  UnknownOperator,
+  UnknownFuncClass,
+  UnknownCallingConv,
+  UnknownStorageClass,
+  UnknownPrimType,
+  BadArrayDimension,
+  BadBackref,
+  Expected,
+  TooDeep,
+  TooManyNodes,
+  TooLong,
+  OutOfMemory,
+};
+
+class Demangler;
+
+// A cache of rendered names that persists across symbols.
+//
+// The same qualified names, especially template instantiations such as
+// std::basic_string<char,...>, appear in many symbols. If a Demangler
+// has a NameCache, read_name() remembers the mangled bytes of each name
+// containing template arguments along with its rendered text, and when
+// it sees the same bytes again, it skips parsing and rendering them.
+//
+// A cached name is only valid in the same backreference context, so
+// entries are keyed by the number of names memorized before the name
+// and are not created for names referring to preceding names.
+//
+// A NameCache must not be used by more than one Demangler at a time.
+class NameCache {
+public:
+  // When entries exceed max_bytes, the cache is cleared before the
+  // next symbol.
+  explicit NameCache(size_t max_bytes) : max_bytes(max_bytes) {}
+
+  struct Stats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+    size_t flushes = 0;
+  };
+
+  const Stats &stats() const { return st; }
+
+private:
+  friend class Demangler;
+
+  struct Entry {
+    // Bytes consumed by read_name() and the result of rendering them.
+    std::string mangled;
+    std::string text;
+
+    // The number of names in names[] before reading this name, and
+    // names memorized while reading it, as offsets and lengths relative
+    // to the beginning of the name.
+    size_t base;
+    std::vector<std::pair<uint32_t, uint32_t>> names;
+
+    size_t size() const {
+      return sizeof(Entry) + mangled.size() + text.size() +
+             names.size() * sizeof(names[0]);
+    }
+  };
+
+  const Entry *find(String input, size_t base);
+  void insert(std::unique_ptr<Entry> e);
+
+  // Called between symbols. Frees evicted entries and clears the cache
+  // if it is full.
+  void release();
+
+  static uint64_t key(String input, size_t base);
+
+  // Each bucket holds recent entries starting with the same identifier.
+  static constexpr size_t bucket_size = 8;
+  std::unordered_map<uint64_t, std::vector<std::unique_ptr<Entry>>> buckets;
+
+  // Entries evicted while demangling a symbol. Names of the symbol may
+  // still point to them, so they are freed by release().
+  std::vector<std::unique_ptr<Entry>> evicted;
+
+  size_t max_bytes;
+  Stats st;
+};
+
+// Demangler class takes the main role in demangling symbols.
+// It has a set of functions to parse mangled symbols into Type instnaces.
+// It also has a set of functions to cnovert Type instances to strings.
+class Demangler {
+public:
+  Demangler() = default;
+  Demangler(String s) : input(s), mangled(s) {}
+
+  // Allocates AST nodes in a given buffer instead of the heap. parse()
+  // fails with OutOfMemory if the buffer is too small for a symbol.
+  // Together with write(), which does not use the output buffer, this
+  // lets you demangle without touching the heap, unless a NameCache is
+  // set.
+  Demangler(void *buf, size_t size) : arena(buf, size) {}
+
+  // Prepares this instance for demangling another symbol. Memory
+  // allocated for the previous symbol is kept and reused, so this is
+  // much cheaper than creating a new Demangler for each symbol.
+  void reset(String s);
+
+  // You are supposed to call parse() first and then check if error is
+  // still NoError. After that, call str() to get a result. str() and
+  // view() fail with TooLong if the result exceeds Limits::max_output,
+  // so error needs to be checked again after them.
+  void parse();
+  std::string str();
+
+  // Same as str(), but returns a view of the internal buffer instead
+  // of a copy. The result is valid until the next reset() or view().
+  String view();
+
+  // Same as view(), but passes the result to a given sink token by
+  // token. Concatenating the tokens gives the same string as view().
+  // Nothing is buffered, so a sink can feed a hash function or write
+  // structured output without creating a string. If this fails with
+  // TooLong, the sink has already received some or all of the tokens.
+  void write(Sink &sink);
+
+  // Limits on resources used for a symbol, so that a malicious or
+  // corrupted symbol cannot exhaust the stack or stall the caller.
+  // Symbols exceeding them fail with TooDeep, TooManyNodes or TooLong.
+  struct Limits {
+    // Nesting of types, e.g. function pointers and template arguments.
+    // Chains of pointers and references do not count.
+    size_t max_depth = 256;
+
+    // The number of Name and Type nodes.
+    size_t max_nodes = 1 << 16;
+
+    // The length of a demangled name. Backreferences make it possible
+    // for a short symbol to represent a very long name.
+    size_t max_output = 1 << 20;
+  };
+
+  void set_limits(const Limits &l) {
+    limits = l;
+    num_ckpts = 0;
+  }
+
+  // Sets RenderFlags for subsequent parse() and view() calls. Names in
+  // a NameCache are rendered with the flags in effect when they are
+  // cached, so don't change flags of a Demangler using a cache.
+  void set_flags(uint8_t f) { flags = f; }
+  uint8_t get_flags() const { return flags; }
+
+  // What validate() tells about a symbol. func_class is a set of
+  // FuncClass flags, which is Global for free functions. func_class and
+  // calling_conv are zero for variables.
+  struct SymbolInfo {
+    SymbolKind kind = NotMangled;
+    uint8_t func_class = 0;
+    CallingConv calling_conv = Cdecl;
+  };
+
+  // Checks if s can be demangled without building an AST or rendering
+  // it. Returns false and sets error as parse() would if s is invalid.
+  // Strings not starting with '?' are valid symbols of kind NotMangled.
+  // The max_output limit is not checked because nothing is rendered.
+  //
+  // This still reads the whole grammar, so it takes about as long as
+  // parse() alone. It saves only the cost of rendering, which makes it
+  // about twice as fast as parse() followed by view().
+  //
+  // The parse result is discarded, so call reset() and parse() if you
+  // need the demangled name.
+  bool validate(String s, SymbolInfo &info);
+
+  // Makes read_name() use a given cache. Null disables caching.
+  void set_name_cache(NameCache *c) {
+    name_cache = c;
+    num_ckpts = 0;
+  }
+
+  // Enables incremental mode for sorted input, in which consecutive
+  // symbols often have the same name, e.g. overloads of a function.
+  // reset() copies each symbol into an internal buffer, and parse()
+  // reuses the nodes of the leading components of the name of the
+  // previous symbol if the symbol starts with the same bytes, instead
+  // of reading them again. This mode has no effect while a NameCache
+  // is set.
+  void set_incremental(bool on) {
+    incremental = on;
+    num_ckpts = 0;
+  }
+
+  // Returns the number of arena bytes used by the current symbol.
+  size_t arena_bytes() const { return arena.used(); }
+
+  // Counters accumulated over all symbols given to this instance. They
+  // are only updated if the demangler is compiled with -DDEMANGLE_STATS
+  // (make STATS=1), and are always zero otherwise.
+  struct Stats {
+    size_t symbols = 0;
+    size_t arena_bytes = 0;
+    size_t arena_chunks = 0;
+    size_t name_nodes = 0;
+    size_t type_nodes = 0;
+
+    // Backreferences to names[] and to the parameter table in
+    // read_params().
+    size_t name_backrefs = 0;
+    size_t param_backrefs = 0;
+
+    // Maximum recursion depths of read_var_type() and write_pre().
+    size_t max_parse_depth = 0;
+    size_t max_write_depth = 0;
+
+    // Time spent in parse() and in view() or str().
+    uint64_t parse_ns = 0;
+    uint64_t render_ns = 0;
+
+    // The symbol that took the longest to parse, truncated to 256 bytes.
+    uint64_t slowest_ns = 0;
+    std::string slowest;
+
+    // Adds counters of another instance to this.
+    void merge(const Stats &s);
+  };
+
+#ifdef DEMANGLE_STATS
+  static constexpr bool stats_enabled = true;
+#else
+  static constexpr bool stats_enabled = false;
+#endif
+
+  Stats stats() const;
+
+  // Calls and time of each TraceRule, accumulated over all symbols. They
+  // are only updated if the demangler is compiled with -DDEMANGLE_TRACE
+  // (make TRACE=1). Without it, the hooks expand to nothing. The
+  // counters exist either way so that the layout of Demangler does not
+  // depend on the flag.
+  //
+  // total_ns includes time spent in rules called by a rule, and self_ns
+  // does not. Reading the clock takes tens of nanoseconds, which is
+  // counted too, so compare numbers of traced builds only.
+  struct Trace {
+    struct Rule {
+      uint64_t calls = 0;
+      uint64_t total_ns = 0;
+      uint64_t self_ns = 0;
+    };
+
+    uint64_t symbols = 0;
+    Rule rules[NumTraceRules];
+
+    void merge(const Trace &t);
+    static const char *rule_name(TraceRule r);
+  };
+
+#ifdef DEMANGLE_TRACE
+  static constexpr bool trace_enabled = true;
+#else
+  static constexpr bool trace_enabled = false;
+#endif
+
+  Trace trace() const { return tr; }
+
+  // The first error found by parse(), and its offset in the input.
+  ErrorCode error = NoError;
+  size_t error_pos = 0;
+
+  std::string error_message() const;
+
+  // Returns the number of bytes of the symbol read by parse(), which
+  // stops at the end of a symbol, so bytes following it are not part
+  // of the demangled name. With NameOnly, parse() stops after the
+  // name, but validate() still reads the whole symbol.
+  size_t consumed() const { return mangled.len - input.len; }
+
+private:
+  // Parser functions. This is a recursive-descendent parser.
+  void parse_symbol();
+  void read_var_type(Type &ty);
+  void read_var_type_chain(Type &ty);
+  void read_member_func_type(Type &ty);
+
+  int read_number();
+  String read_string(bool memorize);
+  void memorize_string(String s);
+  Name *read_name();
+  Name *read_name_elems(Name *head = nullptr);
+  Name *read_cached_name();
+  void cache_name(String mangled, size_t base, Name *name);
+  void read_func_ptr(Type &ty);
+  void read_params_end();
+  void read_var_storage_class();
+  void read_operator(Name *);
+  uint8_t read_operator_code();
+  PrimTy read_prim_type();
+  int read_func_class();
+  int8_t read_func_access_class();
+  CallingConv read_calling_conv();
+  void read_func_return_type(Type &ty);
+  int8_t read_storage_class();
+  int8_t read_storage_class_for_return();
+
+  void read_class(Type &ty, PrimTy prim);
+  void read_array(Type &ty);
+  Type *read_params();
+
+  int peek() { return (input.len == 0) ? -1 : input.p[0]; }
+
+  // Allocate AST nodes in the arena.
+  Name *new_name();
+  Type *new_type();
+  void add_node();
+
+  // If true, which is the case only in validate(), the functions above
+  // return the following nodes instead of allocating new ones. Their
+  // contents are garbage, but nothing reads them until the next reset().
+  bool validating = false;
+  Name scratch_name;
+  Type scratch_type;
+
+  bool consume(String s) {
+    if (!input.startswith(s))
+      return false;
+    input.trim(s.len);
+    return true;
+  }
+
+  void expect(String s) {
+    if (consume(s) || error)
+      return;
+    expected = s;
+    fail(Expected, input);
+  }
+
+  // Records an error found at a given position. Only the first error
+  // is recorded. The rest of the input is discarded so that the parser
+  // stops instead of going on with garbage.
+  void fail(ErrorCode code, String at) {
+    if (error)
+      return;
+    error = code;
+    error_pos = at.p - mangled.p;
+    input = input.substr(input.len);
+  }
+
+  // Mangled symbol. read_* functions shorten this string
+  // as they parse it.
+  String input;
+
+  // The entire mangled symbol given to the constructor or reset().
+  String mangled;
+
+  // What expect() wanted if error is Expected.
+  String expected;
+
+  // A parsed mangled symbol.
+  Type type;
+
+  // The main symbol name. (e.g. "ns::foo" in "int ns::foo()".)
+  Name *symbol = nullptr;
+
+  // Memory allocator.
+  Arena arena;
+
+  // The first 10 names in a mangled name can be back-referenced by
+  // special name @[0-9]. This is a storage for the first 10 names.
+  String names[10];
+  size_t num_names = 0;
+
+  NameCache *name_cache = nullptr;
+
+  // The smallest index of names[] referred to by a backreference or
+  // matched by memorize_string() since the start of the innermost
+  // read_name() call. Used to decide if a name can be cached.
+  size_t min_name_ref = 10;
+
+  // The state of the parser after reading each component of the name
+  // of a symbol in incremental mode. A checkpoint is valid while the
+  // first len bytes of inbuf are unchanged and the arena is not rewound
+  // past its mark.
+  struct Checkpoint {
+    size_t len;
+    Name *head;
+    size_t num_names;
+    size_t num_nodes;
+    Arena::Mark mark;
+  };
+
+  void save_checkpoint(Name *head);
+  Name *resume();
+
+  bool incremental = false;
+
+  // True while parse_symbol() reads the symbol name in incremental mode.
+  bool checkpointing = false;
+
+  // True if reset() kept a checkpoint for parse() to resume from.
+  bool resumable = false;
+
+  Checkpoint ckpts[8];
+  size_t num_ckpts = 0;
+
+  // A copy of the current symbol in incremental mode.
+  std::vector<char> inbuf;
+
+  Limits limits;
+  uint8_t flags = 0;
+
+  // The current recursion depth of read_var_type(), and the number of
+  // nodes allocated for the current symbol.
+  size_t depth = 0;
+  size_t num_nodes = 0;
+
+  // Counters for stats(), and the current recursion depth of
+  // write_pre() to compute its maximum.
+  Stats st;
+  size_t write_depth = 0;
+
+  // The slowest symbol is kept here and copied to Stats::slowest by
+  // stats(), so that parse() does not allocate.
+  static constexpr size_t SlowestSize = 256;
+  char slowest[SlowestSize];
+  size_t slowest_len = 0;
+
+  // Functions to convert Type to String.
+  void render();
+  void write_pre(Type &ty);
+  void write_pre_base(Type &ty);
+  void write_post(Type &ty);
+  void write_class(Name *name, String s);
+  void write_params(Type *ty);
+  void write_name(Name *name);
+  void write_tmpl_params(Name *name);
+  void write_operator(Name *name);
+  void write_space();
+
+  // The result is written to this buffer.
+  Output os;
+
+  // Counters for trace(), and the time spent in rules called by the
+  // current rule.
+  Trace tr;
+  uint64_t trace_child_ns = 0;
+};
+} // namespace ms_demangle
+
+#endif
@@ -0,0 +1,129 @@
+//===- ResultCache.cpp ----------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ResultCache.h"
+
+using namespace ms_demangle;
+
+// An entry is allocated as a single block of memory holding this
+// header followed by the mangled name and the demangled name.
+struct ResultCache::Entry {
+  Entry *prev;
+  Entry *next;
+  size_t key_len;
+  size_t value_len;
+
+  char *data() { return (char *)(this + 1); }
+  String key() { return {data(), key_len}; }
+  String value() { return {data() + key_len, value_len}; }
+
+  // The number of bytes an entry occupies, including an estimate of
+  // the overhead of the hash table.
+  size_t size() { return sizeof(Entry) + key_len + value_len + 32; }
+};
+
+ResultCache::ResultCache(size_t max_bytes, unsigned num_shards)
+    : max_shard_bytes(max_bytes / std::max(1u, num_shards)),
+      num_shards(std::max(1u, num_shards)),
+      shards(new Shard[this->num_shards]) {}
+
+ResultCache::~ResultCache() {
+  for (unsigned i = 0; i < num_shards; ++i) {
+    for (Entry *e = shards[i].head; e;) {
+      Entry *next = e->next;
+      delete[] (char *)e;
+      e = next;
+    }
+  }
+}
+
+void ResultCache::unlink(Shard &s, Entry *e) {
+  (e->prev ? e->prev->next : s.head) = e->next;
+  (e->next ? e->next->prev : s.tail) = e->prev;
+}
+
+void ResultCache::push_front(Shard &s, Entry *e) {
+  e->prev = nullptr;
+  e->next = s.head;
+  (s.head ? s.head->prev : s.tail) = e;
+  s.head = e;
+}
+
+bool ResultCache::lookup(String sym, std::string &out) {
+  Shard &s = shard_for(sym.hash());
+  std::lock_guard<std::mutex> lock(s.mu);
+
+  auto it = s.map.find(sym);
+  if (it == s.map.end()) {
+    s.stats.misses++;
+    return false;
+  }
+
+  Entry *e = it->second;
+  if (e != s.head) {
+    unlink(s, e);
+    push_front(s, e);
+  }
+  String v = e->value();
+  out.append(v.p, v.len);
+  s.stats.hits++;
+  return true;
+}
+
+void ResultCache::insert(String sym, String result) {
+  Entry *e = (Entry *)new char[sizeof(Entry) + sym.len + result.len];
+  e->key_len = sym.len;
+  e->value_len = result.len;
+  // memcpy must not be given null pointers, which empty Strings may have.
+  if (sym.len)
+    memcpy(e->data(), sym.p, sym.len);
+  if (result.len)
+    memcpy(e->data() + sym.len, result.p, result.len);
+
+  if (e->size() > max_shard_bytes) {
+    delete[] (char *)e;
+    return;
+  }
+
+  Shard &s = shard_for(sym.hash());
+  std::lock_guard<std::mutex> lock(s.mu);
+
+  // Another thread may have added the same symbol after our lookup.
+  if (!s.map.emplace(e->key(), e).second) {
+    delete[] (char *)e;
+    return;
+  }
+  push_front(s, e);
+  s.stats.entries++;
+  s.stats.bytes += e->size();
+
+  while (s.stats.bytes > max_shard_bytes) {
+    Entry *victim = s.tail;
+    unlink(s, victim);
+    s.map.erase(victim->key());
+    s.stats.entries--;
+    s.stats.bytes -= victim->size();
+    s.stats.evictions++;
+    delete[] (char *)victim;
+  }
+}
+
+ResultCache::Stats ResultCache::stats() {
+  Stats total;
+  for (unsigned i = 0; i < num_shards; ++i) {
+    std::lock_guard<std::mutex> lock(shards[i].mu);
+    const Stats &s = shards[i].stats;
+    total.hits += s.hits;
+    total.misses += s.misses;
+    total.evictions += s.evictions;
+    total.entries += s.entries;
+    total.bytes += s.bytes;
+  }
+  return total;
+}
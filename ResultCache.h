@@ -0,0 +1,96 @@
+//===- ResultCache.h --------------------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares a cache of demangled names.
+//
+// Symbol dumps of large programs contain the same mangled names many
+// times (inline functions, template instantiations, COMDATs, ...), so
+// batch mode can skip the demangler for most symbols by remembering
+// results.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include "MicrosoftDemangle.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace ms_demangle {
+
+// A bounded map from mangled names to demangled names. When the total
+// size of entries exceeds a limit, least recently used entries are
+// evicted.
+//
+// This class is thread-safe. Entries are distributed to shards by the
+// hash of the mangled name, and each shard has its own lock, so that
+// threads rarely wait for each other if there are enough shards.
+class ResultCache {
+public:
+  // max_bytes is an approximate upper limit of the memory used for
+  // entries, including their bookkeeping data.
+  ResultCache(size_t max_bytes, unsigned num_shards = 1);
+  ~ResultCache();
+
+  // If sym is in the cache, appends its demangled name to out and
+  // returns true.
+  bool lookup(String sym, std::string &out);
+
+  // Adds a demangled name for sym. If the entry alone exceeds the
+  // memory limit of a shard, it is not added.
+  void insert(String sym, String result);
+
+  struct Stats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+  };
+
+  // Returns the sum of statistics of all shards.
+  Stats stats();
+
+private:
+  struct Entry;
+
+  struct StringHash {
+    size_t operator()(String s) const { return s.hash(); }
+  };
+
+  struct Shard {
+    std::mutex mu;
+    std::unordered_map<String, Entry *, StringHash> map;
+
+    // A doubly-linked list of entries in LRU order. The most recently
+    // used entry is at the front.
+    Entry *head = nullptr;
+    Entry *tail = nullptr;
+    Stats stats;
+  };
+
+  // Use the upper bits so that shard selection is independent from
+  // bucket selection in each shard's hash table.
+  Shard &shard_for(uint64_t hash) { return shards[(hash >> 40) % num_shards]; }
+
+  static void unlink(Shard &s, Entry *e);
+  static void push_front(Shard &s, Entry *e);
+
+  size_t max_shard_bytes;
+  unsigned num_shards;
+  std::unique_ptr<Shard[]> shards;
+};
+
+} // namespace ms_demangle
+
+#endif
@@ -0,0 +1,225 @@
+//===- Scan.h ---------------------------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines functions to scan mangled names for '@' terminators
+// and hexadecimal digits, and to find mangled names in text.
+//
+// Identifiers and numbers in mangled names are terminated by '@', so
+// the parser spends a good part of its time looking for that byte. The
+// functions in this file examine 16 bytes at a time with SSE2 or NEON
+// if the compiler targets them. Define DEMANGLE_NO_SIMD (make NO_SIMD=1)
+// to use memchr() and byte-at-a-time loops instead.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if !defined(DEMANGLE_NO_SIMD) && defined(__SSE2__)
+#define DEMANGLE_SSE2
+#include <emmintrin.h>
+#elif !defined(DEMANGLE_NO_SIMD) && defined(__ARM_NEON)
+#define DEMANGLE_NEON
+#include <arm_neon.h>
+#endif
+
+namespace ms_demangle {
+
+// Returns the index of the first '@' in p[0, len), or len if not found.
+inline size_t find_at_scalar(const char *p, size_t len) {
+  for (size_t i = 0; i < len; ++i)
+    if (p[i] == '@')
+      return i;
+  return len;
+}
+
+// Returns the number of leading bytes of p[0, len) that are hexadecimal
+// digits of mangled numbers, which are 'A' to 'P'.
+inline size_t count_hex_digits_scalar(const char *p, size_t len) {
+  for (size_t i = 0; i < len; ++i)
+    if ((uint8_t)(p[i] - 'A') > 15)
+      return i;
+  return len;
+}
+
+// Returns true if c may appear in a mangled name, i.e. if c is a letter,
+// a digit, '_', '?', '@' or '$'. '?' to 'Z' are contiguous in ASCII.
+inline bool is_symbol_char(char c) {
+  return (uint8_t)(c - '?') <= 'Z' - '?' || (uint8_t)(c - 'a') <= 25 ||
+         (uint8_t)(c - '0') <= 9 || c == '_' || c == '$';
+}
+
+// Returns the number of leading bytes of p[0, len) for which
+// is_symbol_char() is true.
+inline size_t count_symbol_chars_scalar(const char *p, size_t len) {
+  for (size_t i = 0; i < len; ++i)
+    if (!is_symbol_char(p[i]))
+      return i;
+  return len;
+}
+
+#if defined(DEMANGLE_SSE2) || defined(DEMANGLE_NEON)
+// Valid numbers have at most 8 digits, and a byte-at-a-time loop is
+// faster for them than a vector comparison. count_hex_digits() below
+// looks at this many bytes one by one before using vectors, which only
+// helps with long runs of garbage.
+static constexpr size_t scalar_prefix = 16;
+#endif
+
+#if defined(DEMANGLE_SSE2)
+static constexpr const char *scan_impl = "sse2";
+
+// Returns the index of the first c in p[0, len), or len if not found.
+inline size_t find_byte(const char *p, size_t len, char c) {
+  const __m128i x = _mm_set1_epi8(c);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+    if (int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, x)))
+      return i + __builtin_ctz(mask);
+  }
+  for (; i < len; ++i)
+    if (p[i] == c)
+      return i;
+  return len;
+}
+
+inline size_t find_at(const char *p, size_t len) {
+  return find_byte(p, len, '@');
+}
+
+inline size_t count_hex_digits(const char *p, size_t len) {
+  size_t i = count_hex_digits_scalar(p, std::min(len, scalar_prefix));
+  if (i < scalar_prefix || i == len)
+    return i;
+
+  const __m128i a = _mm_set1_epi8('A');
+  const __m128i fifteen = _mm_set1_epi8(15);
+  for (; i + 16 <= len; i += 16) {
+    // c is a digit if (unsigned)(c - 'A') <= 15, i.e. if it is not
+    // changed by min(c - 'A', 15).
+    __m128i x = _mm_sub_epi8(_mm_loadu_si128((const __m128i *)(p + i)), a);
+    __m128i ok = _mm_cmpeq_epi8(_mm_min_epu8(x, fifteen), x);
+    if (int mask = ~_mm_movemask_epi8(ok) & 0xffff)
+      return i + __builtin_ctz(mask);
+  }
+  return i + count_hex_digits_scalar(p + i, len - i);
+}
+
+// Returns bytes of v that are in [lo, lo + n] as 0xff.
+inline __m128i in_range(__m128i v, char lo, char n) {
+  __m128i x = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+  return _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(n)), x);
+}
+
+inline size_t count_symbol_chars(const char *p, size_t len) {
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+    __m128i ok = _mm_or_si128(
+        _mm_or_si128(in_range(v, '?', 'Z' - '?'), in_range(v, 'a', 25)),
+        _mm_or_si128(_mm_or_si128(in_range(v, '0', 9),
+                                  _mm_cmpeq_epi8(v, _mm_set1_epi8('_'))),
+                     _mm_cmpeq_epi8(v, _mm_set1_epi8('$'))));
+    if (int mask = ~_mm_movemask_epi8(ok) & 0xffff)
+      return i + __builtin_ctz(mask);
+  }
+  return i + count_symbol_chars_scalar(p + i, len - i);
+}
+
+#elif defined(DEMANGLE_NEON)
+static constexpr const char *scan_impl = "neon";
+
+// NEON has no movemask instruction. Narrowing a comparison result by
+// 4 bits gives a 64-bit mask with 4 bits for each byte.
+inline uint64_t neon_mask(uint8x16_t cmp) {
+  uint8x8_t m = vshrn_n_u16(vreinterpretq_u16_u8(cmp), 4);
+  return vget_lane_u64(vreinterpret_u64_u8(m), 0);
+}
+
+inline size_t find_byte(const char *p, size_t len, char c) {
+  const uint8x16_t x = vdupq_n_u8(c);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    uint8x16_t v = vld1q_u8((const uint8_t *)p + i);
+    if (uint64_t mask = neon_mask(vceqq_u8(v, x)))
+      return i + (__builtin_ctzll(mask) >> 2);
+  }
+  for (; i < len; ++i)
+    if (p[i] == c)
+      return i;
+  return len;
+}
+
+inline size_t find_at(const char *p, size_t len) {
+  return find_byte(p, len, '@');
+}
+
+inline size_t count_hex_digits(const char *p, size_t len) {
+  size_t i = count_hex_digits_scalar(p, std::min(len, scalar_prefix));
+  if (i < scalar_prefix || i == len)
+    return i;
+
+  const uint8x16_t a = vdupq_n_u8('A');
+  const uint8x16_t fifteen = vdupq_n_u8(15);
+  for (; i + 16 <= len; i += 16) {
+    uint8x16_t x = vsubq_u8(vld1q_u8((const uint8_t *)p + i), a);
+    if (uint64_t mask = neon_mask(vcgtq_u8(x, fifteen)))
+      return i + (__builtin_ctzll(mask) >> 2);
+  }
+  return i + count_hex_digits_scalar(p + i, len - i);
+}
+
+inline uint8x16_t in_range(uint8x16_t v, char lo, char n) {
+  return vcleq_u8(vsubq_u8(v, vdupq_n_u8(lo)), vdupq_n_u8(n));
+}
+
+inline size_t count_symbol_chars(const char *p, size_t len) {
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    uint8x16_t v = vld1q_u8((const uint8_t *)p + i);
+    uint8x16_t ok = vorrq_u8(
+        vorrq_u8(in_range(v, '?', 'Z' - '?'), in_range(v, 'a', 25)),
+        vorrq_u8(vorrq_u8(in_range(v, '0', 9), vceqq_u8(v, vdupq_n_u8('_'))),
+                 vceqq_u8(v, vdupq_n_u8('$'))));
+    if (uint64_t mask = neon_mask(vmvnq_u8(ok)))
+      return i + (__builtin_ctzll(mask) >> 2);
+  }
+  return i + count_symbol_chars_scalar(p + i, len - i);
+}
+
+#else
+static constexpr const char *scan_impl = "memchr";
+
+inline size_t find_byte(const char *p, size_t len, char c) {
+  const char *q = (const char *)memchr(p, c, len);
+  return q ? q - p : len;
+}
+
+inline size_t find_at(const char *p, size_t len) {
+  return find_byte(p, len, '@');
+}
+
+inline size_t count_hex_digits(const char *p, size_t len) {
+  return count_hex_digits_scalar(p, len);
+}
+
+inline size_t count_symbol_chars(const char *p, size_t len) {
+  return count_symbol_chars_scalar(p, len);
+}
+#endif
+
+} // namespace ms_demangle
+
+#endif
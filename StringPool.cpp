@@ -0,0 +1,168 @@
+//===- StringPool.cpp -----------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "StringPool.h"
+
+using namespace ms_demangle;
+
+static uint8_t *write_uleb128(uint8_t *p, uint64_t x) {
+  do {
+    uint8_t b = x & 0x7f;
+    x >>= 7;
+    *p++ = b | (x ? 0x80 : 0);
+  } while (x);
+  return p;
+}
+
+static const uint8_t *read_uleb128(const uint8_t *p, uint64_t &x) {
+  x = 0;
+  for (int shift = 0;; shift += 7) {
+    uint8_t b = *p++;
+    x |= (uint64_t)(b & 0x7f) << shift;
+    if (!(b & 0x80))
+      return p;
+  }
+}
+
+StringPool::Handle StringPool::add(String s) {
+  st.strings++;
+  st.string_bytes += s.len;
+
+  // Split s after each "::" of its leading scopes. Template arguments
+  // are skipped, and the parameter list of a function ends the scopes.
+  // Unbalanced '<' and '>' of operator names only end it early.
+  Handle h = 0;
+  size_t begin = 0;
+  if (opts.share_prefixes) {
+    int depth = 0;
+    for (size_t i = 0; i + 1 < s.len; ++i) {
+      char c = s.p[i];
+      if (c == '<') {
+        depth++;
+      } else if (c == '>') {
+        depth--;
+      } else if (c == '(' && depth == 0) {
+        break;
+      } else if (c == ':' && s.p[i + 1] == ':' && depth == 0) {
+        h = insert(h, s.substr(begin, i + 2 - begin), true);
+        if (!h)
+          return 0;
+        begin = i + 2;
+        i++;
+      }
+    }
+  }
+  return insert(h, s.substr(begin), opts.dedup);
+}
+
+// Returns a record for parent and s, which is an existing one if dedup
+// is true and there is one.
+StringPool::Handle StringPool::insert(Handle parent, String s, bool dedup) {
+  while (s.len > max_record) {
+    parent = append(parent, s.substr(0, max_record));
+    if (!parent)
+      return 0;
+    s.trim(max_record);
+  }
+  if (!dedup)
+    return append(parent, s);
+
+  uint32_t tag = (s.hash() ^ (parent * 0x9e3779b97f4a7c15)) >> 32;
+
+  if (table.empty())
+    grow_table();
+  size_t mask = table.size() - 1;
+  size_t i = tag & mask;
+  for (; table[i].handle; i = (i + 1) & mask) {
+    if (table[i].tag != tag)
+      continue;
+    String t;
+    if (read(table[i].handle, t) == parent && t == s)
+      return table[i].handle;
+  }
+
+  Handle h = append(parent, s);
+  if (!h)
+    return 0;
+  table[i] = {h, tag};
+  if (++table_entries * 4 >= table.size() * 3)
+    grow_table();
+  return h;
+}
+
+// Appends a new record.
+StringPool::Handle StringPool::append(Handle parent, String s) {
+  uint8_t header[20];
+  uint8_t *end = write_uleb128(write_uleb128(header, parent), s.len);
+  size_t size = end - header + s.len;
+  size = (size + 1) & ~(size_t)1;
+
+  if (page_used + size > page_size) {
+    if ((pages.size() + 1) * page_size / 2 > (size_t)UINT32_MAX + 1)
+      return 0;
+    pages.emplace_back(new uint8_t[page_size]);
+    st.page_bytes += page_size;
+    // Offset 0 is not used so that no record has handle 0.
+    page_used = pages.size() == 1 ? 2 : 0;
+  }
+
+  uint8_t *p = pages.back().get() + page_used;
+  memcpy(p, header, end - header);
+  memcpy(p + (end - header), s.p, s.len);
+
+  Handle h = ((pages.size() - 1) * page_size + page_used) / 2;
+  page_used += size;
+  st.records++;
+  st.record_bytes += size;
+  return h;
+}
+
+// Tags are used as hash values, so records need not be read to move
+// them to a larger table.
+void StringPool::grow_table() {
+  std::vector<Slot> old(table.empty() ? 1024 : table.size() * 2);
+  old.swap(table);
+  st.table_bytes = table.size() * sizeof(Slot);
+
+  size_t mask = table.size() - 1;
+  for (const Slot &slot : old) {
+    if (!slot.handle)
+      continue;
+    size_t i = slot.tag & mask;
+    while (table[i].handle)
+      i = (i + 1) & mask;
+    table[i] = slot;
+  }
+}
+
+StringPool::Handle StringPool::read(Handle h, String &s) const {
+  size_t off = (size_t)h * 2;
+  const uint8_t *p = pages[off / page_size].get() + off % page_size;
+  uint64_t parent, len;
+  p = read_uleb128(read_uleb128(p, parent), len);
+  s = String((const char *)p, len);
+  return parent;
+}
+
+void StringPool::get(Handle h, std::string &out) const {
+  // Records are chained from the end of a string to its beginning, so
+  // compute the length first and then fill the result backwards.
+  size_t len = 0;
+  String s;
+  for (Handle x = h; x; len += s.len)
+    x = read(x, s);
+
+  size_t end = out.size() + len;
+  out.resize(end);
+  for (Handle x = h; x;) {
+    x = read(x, s);
+    end -= s.len;
+    memcpy(&out[end], s.p, s.len);
+  }
+}
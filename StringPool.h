@@ -0,0 +1,122 @@
+//===- StringPool.h ---------------------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares a compact store for demangled names.
+//
+// A program that keeps millions of demangled names in memory, such as
+// a symbolizer, pays for a heap block and a std::string for each of
+// them, and most of the bytes are the same scopes ("std::", "class
+// std::allocator<char>", ...) over and over. StringPool appends names
+// to large pages and returns 32-bit handles instead. It can also store
+// a name that was added before only once, and store the scopes of
+// names once and refer to them from each name.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef STRING_POOL_H
+#define STRING_POOL_H
+
+#include "MicrosoftDemangle.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ms_demangle {
+
+// Strings are stored as records in pages. A record has the handle of
+// a parent record, the length of its bytes, and the bytes. The string
+// for a handle is the string for its parent followed by the bytes, so
+// records can share their leading parts.
+//
+// A handle is the offset of a record in units of 2 bytes, so a pool
+// can hold up to 8 GiB of records. Handle 0 is never returned for a
+// string. This class is not thread-safe.
+class StringPool {
+public:
+  typedef uint32_t Handle;
+
+  struct Options {
+    // If true, add() returns the same handle for the same string.
+    bool dedup = false;
+
+    // If true, the leading scopes of names are stored once per pool.
+    // For "int ns::klass<int>::f(void)", "int ns::" and "klass<int>::"
+    // are stored as records shared with other names in the same
+    // scopes, and only "f(void)" is stored for this name.
+    bool share_prefixes = false;
+  };
+
+  StringPool() = default;
+  explicit StringPool(const Options &opts) : opts(opts) {}
+  StringPool(const StringPool &) = delete;
+  StringPool &operator=(const StringPool &) = delete;
+
+  // Adds s and returns its handle. Returns 0 if the pool is full.
+  Handle add(String s);
+
+  // Appends the string for h to out.
+  void get(Handle h, std::string &out) const;
+
+  std::string get(Handle h) const {
+    std::string s;
+    get(h, s);
+    return s;
+  }
+
+  struct Stats {
+    // The number of add() calls and the total length of their strings.
+    size_t strings = 0;
+    size_t string_bytes = 0;
+
+    // The number of records and bytes used by them.
+    size_t records = 0;
+    size_t record_bytes = 0;
+
+    // Memory allocated for pages and for the hash table.
+    size_t page_bytes = 0;
+    size_t table_bytes = 0;
+
+    size_t memory() const { return page_bytes + table_bytes; }
+  };
+
+  const Stats &stats() const { return st; }
+
+private:
+  static constexpr size_t page_size = 1 << 20;
+
+  // Records longer than this are split so that a record fits in a page.
+  static constexpr size_t max_record = page_size / 2;
+
+  struct Slot {
+    Handle handle;
+    uint32_t tag; // the upper half of the hash of a record
+  };
+
+  Handle insert(Handle parent, String s, bool dedup);
+  Handle append(Handle parent, String s);
+  void grow_table();
+
+  // Returns the parent of h and sets s to its bytes.
+  Handle read(Handle h, String &s) const;
+
+  Options opts;
+  Stats st;
+
+  std::vector<std::unique_ptr<uint8_t[]>> pages;
+  size_t page_used = page_size;
+
+  // An open-addressing hash table of records for dedup and prefixes.
+  std::vector<Slot> table;
+  size_t table_entries = 0;
+};
+
+} // namespace ms_demangle
+
+#endif
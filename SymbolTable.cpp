@@ -0,0 +1,89 @@
+//===- SymbolTable.cpp ----------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "SymbolTable.h"
+
+using namespace ms_demangle;
+
+SymbolTable::SymbolTable(const std::vector<String> &syms, const Options &opts)
+    : opts(opts), entries(new Entry[syms.size()]), num_entries(syms.size()),
+      pool(opts.pool) {
+  Demangler demangler;
+  demangler.set_limits(opts.limits);
+  for (size_t i = 0; i < num_entries; ++i) {
+    Entry &e = entries[i];
+    e.sym = syms[i];
+    e.valid = e.sym.startswith('?') &&
+              (!opts.validate || demangler.validate(e.sym, e.info));
+  }
+}
+
+std::unique_ptr<Demangler> SymbolTable::get_demangler() {
+  {
+    std::lock_guard<std::mutex> lock(mu);
+    if (!demanglers.empty()) {
+      std::unique_ptr<Demangler> d = std::move(demanglers.back());
+      demanglers.pop_back();
+      return d;
+    }
+  }
+  std::unique_ptr<Demangler> d(new Demangler);
+  d->set_limits(opts.limits);
+  d->set_flags(opts.flags);
+  return d;
+}
+
+void SymbolTable::name(size_t i, std::string &out) {
+  Entry &e = entries[i];
+  if (!e.valid) {
+    out.append(e.sym.p, e.sym.len);
+    return;
+  }
+
+  if (StringPool::Handle h = e.handle.load(std::memory_order_acquire)) {
+    std::lock_guard<std::mutex> lock(mu);
+    pool.get(h, out);
+    return;
+  }
+
+  // Demangle the symbol without holding the lock, so that threads can
+  // demangle different symbols at once.
+  std::unique_ptr<Demangler> d = get_demangler();
+  d->reset(e.sym);
+  d->parse();
+
+  // view() can fail even if validate() succeeded, because validate()
+  // does not check max_output. The symbol itself is then stored, so
+  // that it is counted and demangled only once.
+  String s = d->error ? e.sym : d->view();
+  bool ok = !d->error;
+  if (!ok)
+    s = e.sym;
+  size_t len = out.size();
+  out.append(s.p, s.len);
+
+  std::lock_guard<std::mutex> lock(mu);
+  demanglers.push_back(std::move(d));
+
+  // Another thread may have stored the same name.
+  if (e.handle.load(std::memory_order_relaxed))
+    return;
+  if (StringPool::Handle h = pool.add(String(out).substr(len))) {
+    e.handle.store(h, std::memory_order_release);
+    if (ok)
+      demangled++;
+    else
+      failed++;
+  }
+}
+
+StringPool::Stats SymbolTable::pool_stats() const {
+  std::lock_guard<std::mutex> lock(mu);
+  return pool.stats();
+}
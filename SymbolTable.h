@@ -0,0 +1,123 @@
+//===- SymbolTable.h --------------------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares a table of symbols that are demangled on demand.
+//
+// A symbolizer loads all symbols of a program, but only shows a few of
+// them to a user. SymbolTable checks symbols with Demangler::validate()
+// when it is created, which takes about half as long as demangling them
+// because nothing is rendered, and demangles a symbol only when its name
+// is first asked for. Results are kept in a StringPool.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include "MicrosoftDemangle.h"
+#include "StringPool.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ms_demangle {
+
+// Symbols are not copied, so they must outlive the table. Symbols from
+// for_each_coff_symbol() can be given as they are, as long as their
+// MappedFile is open. All member functions are thread-safe.
+class SymbolTable {
+public:
+  struct Options {
+    Demangler::Limits limits;
+    uint8_t flags = 0;
+
+    // If false, symbols are not checked with validate() when the table
+    // is created, which then takes little more than copying Strings.
+    // valid() is true for all symbols starting with '?', and info() is
+    // not set.
+    bool validate = true;
+
+    // StringPool options for demangled names.
+    StringPool::Options pool;
+  };
+
+  explicit SymbolTable(const std::vector<String> &syms)
+      : SymbolTable(syms, Options()) {}
+  SymbolTable(const std::vector<String> &syms, const Options &opts);
+  SymbolTable(const SymbolTable &) = delete;
+  SymbolTable &operator=(const SymbolTable &) = delete;
+
+  size_t size() const { return num_entries; }
+  String mangled(size_t i) const { return entries[i].sym; }
+
+  // Returns false if symbol i cannot be demangled.
+  bool valid(size_t i) const { return entries[i].valid; }
+
+  // What validate() told about symbol i.
+  const Demangler::SymbolInfo &info(size_t i) const {
+    return entries[i].info;
+  }
+
+  // Appends the demangled name of symbol i to out, or the symbol itself
+  // if it cannot be demangled. The symbol is demangled by the first
+  // call for it. If threads call this for the same symbol at the same
+  // time, more than one of them may demangle it, but all of them get
+  // the same result.
+  void name(size_t i, std::string &out);
+
+  std::string name(size_t i) {
+    std::string s;
+    name(i, s);
+    return s;
+  }
+
+  // The number of symbols demangled so far.
+  size_t num_demangled() const { return demangled; }
+
+  // The number of symbols that failed to demangle when their names were
+  // first asked for, e.g. because they exceeded Limits::max_output, and
+  // for which name() gave the symbol itself. They are not counted by
+  // num_demangled().
+  size_t num_failed() const { return failed; }
+
+  // Statistics of the pool of demangled names.
+  StringPool::Stats pool_stats() const;
+
+private:
+  struct Entry {
+    String sym;
+    Demangler::SymbolInfo info;
+    bool valid = false;
+
+    // The handle of the demangled name in pool, or 0 if the symbol has
+    // not been demangled.
+    std::atomic<StringPool::Handle> handle{0};
+  };
+
+  std::unique_ptr<Demangler> get_demangler();
+
+  Options opts;
+  std::unique_ptr<Entry[]> entries;
+  size_t num_entries;
+  std::atomic<size_t> demangled{0};
+  std::atomic<size_t> failed{0};
+
+  // mu guards pool and demanglers, which are idle Demanglers to be
+  // reused by name().
+  mutable std::mutex mu;
+  StringPool pool;
+  std::vector<std::unique_ptr<Demangler>> demanglers;
+};
+
+} // namespace ms_demangle
+
+#endif
@@ -0,0 +1,139 @@
+//===- alloctest.cpp ------------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Counts heap allocations made while demangling symbols read from stdin.
+// A warmed-up Demangler is expected to demangle without allocating any
+// memory, so this program fails if the second pass allocates. It also
+// checks that chunks of a dead Arena are reused by the next one, and
+// that the C interface never allocates and agrees with Demangler.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CApi.h"
+#include "MicrosoftDemangle.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+using namespace ms_demangle;
+
+static size_t num_allocs = 0;
+static size_t num_chunk_allocs = 0;
+
+void *operator new(size_t size) {
+  num_allocs++;
+  if (size == Arena::default_chunk_size)
+    num_chunk_allocs++;
+  if (void *p = malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+static size_t demangle_all(Demangler &demangler,
+                           const std::vector<std::string> &syms) {
+  size_t before = num_allocs;
+  for (const std::string &sym : syms) {
+    demangler.reset(sym);
+    demangler.parse();
+    if (!demangler.error)
+      demangler.view();
+  }
+  return num_allocs - before;
+}
+
+// Allocates objects of various sizes, including ones larger than a
+// chunk, and returns the number of chunks allocated from the heap.
+static size_t fill_arena(Arena &arena) {
+  size_t before = num_chunk_allocs;
+  for (size_t i = 1; i < 3 * Arena::default_chunk_size; i += 97) {
+    uint8_t *p = (uint8_t *)arena.alloc(i);
+    if ((uintptr_t)p % alignof(std::max_align_t)) {
+      std::cout << "misaligned allocation of " << i << " bytes\n";
+      exit(1);
+    }
+    memset(p, 0xff, i);
+  }
+  return num_chunk_allocs - before;
+}
+
+// Demangles symbols with msvc_demangle() and returns false if it
+// allocates memory or its results differ from Demangler::str().
+static bool check_c_api(const std::vector<std::string> &syms) {
+  char out[4096];
+  for (const std::string &sym : syms) {
+    size_t before = num_allocs;
+    ptrdiff_t n = msvc_demangle(sym.data(), sym.size(), out, sizeof(out));
+    if (num_allocs != before) {
+      std::cout << "msvc_demangle allocated memory: " << sym << "\n";
+      return false;
+    }
+
+    Demangler demangler(sym);
+    demangler.parse();
+    std::string expected;
+    if (!demangler.error)
+      expected = demangler.str();
+    bool ok = demangler.error ? (n == MSVC_DEMANGLE_INVALID)
+                              : (n == (ptrdiff_t)expected.size() &&
+                                 (expected.size() >= sizeof(out) ||
+                                  expected == out));
+    if (!ok) {
+      std::cout << "msvc_demangle: " << sym << ": got " << n << " " << out
+                << "\n";
+      return false;
+    }
+  }
+
+  // Truncation, and a scratch buffer that is too small.
+  const char sym[] = "?x@@YAXMH@Z";
+  if (msvc_demangle(sym, strlen(sym), out, 5) != 17 || strcmp(out, "void") ||
+      msvc_demangle(sym, strlen(sym), nullptr, 0) != 17) {
+    std::cout << "msvc_demangle: bad truncation\n";
+    return false;
+  }
+  char scratch[64];
+  if (msvc_demangle_scratch(sym, strlen(sym), out, sizeof(out), scratch,
+                            sizeof(scratch)) != MSVC_DEMANGLE_NO_MEMORY) {
+    std::cout << "msvc_demangle_scratch: out of memory expected\n";
+    return false;
+  }
+  return true;
+}
+
+int main() {
+  {
+    Arena arena;
+    fill_arena(arena);
+  }
+  Arena arena;
+  if (size_t n = fill_arena(arena)) {
+    std::cout << n << " chunks allocated with a warm free list\n";
+    return 1;
+  }
+
+  std::vector<std::string> syms;
+  for (std::string line; std::getline(std::cin, line);)
+    syms.push_back(line);
+
+  if (!check_c_api(syms))
+    return 1;
+
+  Demangler demangler;
+  size_t cold = demangle_all(demangler, syms);
+  size_t warm = demangle_all(demangler, syms);
+
+  std::cout << syms.size() << " symbols, " << cold
+            << " allocations in the first pass, " << warm
+            << " in the second pass\n";
+  return warm == 0 ? 0 : 1;
+}
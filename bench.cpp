@@ -0,0 +1,805 @@
+//===- bench.cpp ----------------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Benchmarks for the demangler.
+//
+// Usage: benchmark [<corpus>]
+//        benchmark --generate <n> [<seed>]
+//
+// The first form runs microbenchmarks for each area of the grammar and
+// then demangles a corpus, a file containing mangled symbols one per
+// line. If no corpus is given, synthetic symbols are used instead.
+//
+// The second form prints n synthetic symbols to stdout, which can be
+// saved and given as a corpus later.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Batch.h"
+#include "Filter.h"
+#include "MicrosoftDemangle.h"
+#include "Scan.h"
+#include "StringPool.h"
+#include "SymbolTable.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <thread>
+
+using namespace ms_demangle;
+
+// Heap allocations are counted to check that the demangler does not
+// allocate memory for each symbol.
+static std::atomic<size_t> num_allocs(0);
+
+void *operator new(size_t size) {
+  num_allocs.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// Generates random symbols that the demangler accepts. Symbols are made
+// in the order the parser reads them, so that the generator can track
+// memorized names and parameter types and emit valid backreferences.
+// (That is why strings are built by separate statements below; the
+// operands of a + are evaluated in an unspecified order.)
+class Generator {
+public:
+  explicit Generator(unsigned seed) : rng(seed) {}
+
+  std::string symbol() {
+    names.clear();
+    switch (pick(10)) {
+    case 0:
+    case 1:
+    case 2: {
+      // Variable
+      std::string s = "?" + qualified_name(1) + "3";
+      std::string ty = var_type(3);
+      return s + ty + (ty[0] == 'P' || ty[0] == 'A' ? "EA" : "A");
+    }
+    case 3:
+    case 4:
+    case 5: {
+      // Free function
+      std::string s = "?" + qualified_name(1) + "YA";
+      s += ret_type(2);
+      return s + func_params(2);
+    }
+    case 6:
+    case 7:
+    case 8: {
+      // Member function
+      static const char *access[] = {"QEAA", "QEBA", "AEAA", "IEAA", "UEAA"};
+      std::string s = "?" + name_elem();
+      s += qualified_name(2);
+      s += access[pick(5)];
+      s += ret_type(2);
+      return s + func_params(2);
+    }
+    default: {
+      // Operator, constructor or destructor
+      static const char *ops[] = {"0", "1", "4", "8", "9", "A", "D", "H",
+                                  "M", "R", "Y", "_4", "_U", "_V"};
+      std::string op = ops[pick(sizeof(ops) / sizeof(*ops))];
+      // An operator is followed by an identifier, which is read as a
+      // part of the same name component.
+      std::string s = "??" + op + name_elem(false);
+      s += scope() + "QEAA";
+      if (op == "0" || op == "1")
+        return s + "@" + func_params(1);
+      s += ret_type(2);
+      return s + func_params(2);
+    }
+    }
+  }
+
+private:
+  unsigned pick(unsigned n) { return rng() % n; }
+
+  std::string ident() {
+    static const char *words[] = {
+        "std",       "vector",      "basic_string", "allocator", "map",
+        "pair",      "char_traits", "shared_ptr",   "Widget",    "Renderer",
+        "impl",      "detail",      "llvm",         "StringRef", "DenseMap",
+        "get",       "set",         "size",         "begin",     "insert",
+        "find",      "create",      "update",       "Context",   "Node",
+        "Value",     "Type",        "Module",       "Function",  "Builder",
+        "operation", "x",           "y",            "buffer",    "handler"};
+    return words[pick(sizeof(words) / sizeof(*words))];
+  }
+
+  // Same as Demangler::memorize_string().
+  void memorize(const std::string &s) {
+    if (names.size() < 10 && std::find(names.begin(), names.end(), s) ==
+                                 names.end())
+      names.push_back(s);
+  }
+
+  // Returns a non-template name component or a backreference to it.
+  std::string name_elem(bool allow_ref = true) {
+    if (allow_ref && !names.empty() && pick(5) == 0)
+      return std::string(1, '0' + pick(names.size()));
+    std::string s = ident();
+    memorize(s);
+    return s + "@";
+  }
+
+  // Returns a qualified name such as "x@ns@@".
+  std::string qualified_name(int depth) {
+    std::string s = (depth > 0 && pick(3) == 0) ? template_name(depth)
+                                                : name_elem();
+    return s + scope();
+  }
+
+  // Returns zero or more enclosing namespaces or classes and the
+  // terminator of a qualified name.
+  std::string scope() {
+    std::string s;
+    for (unsigned i = pick(3); i > 0; --i)
+      s += name_elem();
+    return s + "@";
+  }
+
+  std::string template_name(int depth) {
+    std::string s = "?$" + ident() + "@";
+    return s + params(depth - 1, 1 + pick(3)) + "@";
+  }
+
+  // Returns n types, some of which may be backreferences to preceding
+  // types in the same list.
+  std::string params(int depth, unsigned n) {
+    std::string s;
+    unsigned nrefs = 0;
+    for (unsigned i = 0; i < n; ++i) {
+      if (nrefs > 0 && pick(3) == 0) {
+        s += '0' + pick(nrefs);
+        continue;
+      }
+      std::string ty = var_type(depth);
+      if (ty.size() > 1 && nrefs < 10)
+        nrefs++;
+      s += ty;
+    }
+    return s;
+  }
+
+  std::string func_params(int depth) {
+    if (pick(5) == 0)
+      return "XZ";
+    return params(depth, 1 + pick(6)) + "@Z";
+  }
+
+  std::string ret_type(int depth) {
+    return pick(4) ? var_type(depth) : "X";
+  }
+
+  std::string var_type(int depth) {
+    static const char *prims[] = {"D", "E", "F", "H", "I", "J", "K",
+                                  "M", "N", "_J", "_K", "_N", "_W"};
+    switch (depth > 0 ? pick(10) : 0) {
+    case 0:
+    case 1:
+    case 2:
+      return prims[pick(sizeof(prims) / sizeof(*prims))];
+    case 3:
+      return (pick(2) ? "PEA" : "PEB") + var_type(depth - 1);
+    case 4:
+      return (pick(2) ? "AEA" : "AEB") + var_type(depth - 1);
+    case 5: {
+      std::string s = (pick(2) ? "V" : "U") + name_elem();
+      return s + qualified_name(depth - 1);
+    }
+    case 6: {
+      std::string s = "PEAV" + template_name(depth);
+      return s + scope();
+    }
+    case 7: {
+      std::string s = "P6A" + ret_type(depth - 1);
+      return s + func_params(depth - 1);
+    }
+    case 8: {
+      unsigned n = 1 + pick(3);
+      std::string s = "PEAY" + number(n);
+      for (unsigned i = 0; i < n; ++i)
+        s += number(1 + pick(5000));
+      return s + prims[pick(sizeof(prims) / sizeof(*prims))];
+    }
+    default: {
+      std::string s = "W4" + name_elem();
+      return s + scope();
+    }
+    }
+  }
+
+  // The inverse of Demangler::read_number() for positive numbers.
+  static std::string number(unsigned n) {
+    if (n <= 10)
+      return std::string(1, '0' + n - 1);
+    std::string s;
+    for (; n; n /= 16)
+      s.insert(s.begin(), 'A' + n % 16);
+    return s + "@";
+  }
+
+  std::mt19937 rng;
+  std::vector<std::string> names;
+};
+
+static std::vector<std::string> generate(size_t n, unsigned seed) {
+  Generator gen(seed);
+  std::vector<std::string> v;
+  for (size_t i = 0; i < n; ++i)
+    v.push_back(gen.symbol());
+  return v;
+}
+
+static std::vector<std::string> load_corpus(const char *path) {
+  if (!path)
+    return generate(200000, 1);
+
+  FILE *in = fopen(path, "rb");
+  if (!in) {
+    perror(path);
+    exit(1);
+  }
+  std::vector<std::string> v;
+  LineReader reader(in);
+  std::vector<String> lines;
+  while (reader.next(lines))
+    for (String s : lines)
+      v.push_back(s.str());
+  fclose(in);
+  return v;
+}
+
+static double now() {
+  using namespace std::chrono;
+  return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Symbols for microbenchmarks, grouped by the part of the grammar they
+// exercise.
+struct MicroBench {
+  const char *name;
+  std::vector<const char *> syms;
+};
+
+static const MicroBench micro_benches[] = {
+    {"variables",
+     {"?x@@3HA", "?x@ns@@3PEAHEA", "?x@@3PEAPEAHEA", "?x@@3PEBHEB",
+      "?value@detail@llvm@@3_KA", "?x@@3PEAVklass@ns@@EA"}},
+    {"free functions",
+     {"?x@@YAXMH@Z", "?create@llvm@@YAPEAVModule@1@AEBVStringRef@1@@Z",
+      "?size@@YA_KPEBD@Z", "?update@detail@@YAXAEAUContext@@_N@Z",
+      "?main@@YAHHPEAPEAD@Z"}},
+    {"member functions",
+     {"?fn@?$klass@H@ns@@QEBAIXZ", "?get@Widget@@QEBAHXZ",
+      "?insert@Node@llvm@@QEAAXPEAV12@_N@Z", "?begin@Buffer@@UEAAPEADXZ",
+      "?update@Renderer@@IEAAXAEBUContext@@M@Z"}},
+    {"operators",
+     {"??4klass@@QEAAAEBV0@AEBV0@@Z", "??0klass@@QEAA@XZ",
+      "??1klass@@QEAA@XZ", "??8Value@@QEBA_NAEBV0@@Z",
+      "??2@YAPEAX_KAEAVklass@@@Z", "??RHandler@@QEAAXH@Z"}},
+    {"function pointers",
+     {"?x@@3P6AHMNH@ZEA", "?x@@3P6AHP6AHM@ZN@ZEA", "?x@@3P6AHP6AHM@Z0@ZEA",
+      "?instance$initializer$@@3P6AXXZEA",
+      "?set@@YAXP6AXPEAX@Z0@Z"}},
+    {"arrays",
+     {"?x@@3PEAY02HEA", "?x@@3PEAY124HEA", "?x@@3PEAY02$$CBHEA",
+      "?x@@3PEAY1NKM@5HEA", "?table@@3PEAY1BAA@BAA@MEA"}},
+    {"deep templates",
+     {"?x@@3PEAV?$tmpl@V?$tmpl@V?$tmpl@H@@@@@@EA",
+      "?x@@3PEAV?$a@V?$b@V?$c@V?$d@V?$e@H@@@@@@@@@@EA",
+      "?x@ns@@3PEAV?$klass@HH@1@EA",
+      "?get@?$map@V?$basic_string@DU?$char_traits@D@std@@V?$allocator@D@1@"
+      "@std@@H@std@@QEAAAEAHAEBV?$basic_string@DU?$char_traits@D@std@@V?$"
+      "allocator@D@1@@1@@Z"}},
+    {"backreferences",
+     {"?x@@YAHPEAVklass@@AEAV1@@Z",
+      "?f@@YAXPEAVa@@PEAVb@@PEAVc@@012@Z",
+      "?f@ns@@YAXPEAVa@1@PEAVb@1@01PEAVc@1@210@Z",
+      "?f@@YAXPEAHPEAD01PEAM201@Z",
+      "?f@x@y@z@@YAXPEAV123@PEAV213@PEAV321@012@Z"}},
+    {"STL backreferences",
+     {"?f@@YAXV?$basic_string@DU?$char_traits@D@std@@V?$allocator@D@std@@@"
+      "std@@00000@Z",
+      "?copy@std@@YAXV?$_Vector_iterator@V?$_Vector_val@U?$_Simple_types@H@"
+      "std@@@std@@@1@000@Z",
+      "?g@@YAXPEAV?$map@HHU?$less@H@std@@@std@@0000000@Z"}},
+};
+
+// Demangles each set of symbols repeatedly for a fixed period and prints
+// the average time per symbol.
+static void bench_micro() {
+  Demangler demangler;
+
+  printf("%-20s %10s\n", "benchmark", "ns/symbol");
+  for (const MicroBench &b : micro_benches) {
+    std::vector<String> syms;
+    for (const char *s : b.syms) {
+      demangler.reset(String(s));
+      demangler.parse();
+      if (demangler.error)
+        printf("warning: %s: %s\n", s, demangler.error_message().c_str());
+      else
+        syms.push_back(String(s));
+    }
+    if (syms.empty())
+      continue;
+
+    size_t count = 0;
+    double start = now();
+    double elapsed;
+    do {
+      for (int i = 0; i < 1000; ++i) {
+        for (String s : syms) {
+          demangler.reset(s);
+          demangler.parse();
+          demangler.view();
+        }
+      }
+      count += 1000 * syms.size();
+      elapsed = now() - start;
+    } while (elapsed < 0.2);
+    printf("%-20s %10.1f\n", b.name, elapsed * 1e9 / count);
+  }
+}
+
+// Splits a buffer consisting of n words of a given length separated by
+// '@' using a given scanner and returns the time per word.
+template <typename Fn>
+static double time_scan(const std::string &buf, size_t n, Fn scan) {
+  size_t count = 0;
+  size_t sum = 0;
+  double start = now();
+  double elapsed;
+  do {
+    const char *p = buf.data();
+    const char *end = p + buf.size();
+    while (p < end) {
+      size_t i = scan(p, end - p);
+      sum += i;
+      p += i + 1;
+    }
+    count += n;
+    elapsed = now() - start;
+  } while (elapsed < 0.1);
+
+  // Use the result so that the loop is not optimized away.
+  if (sum == 0)
+    printf(" ");
+  return elapsed * 1e9 / count;
+}
+
+// Compares the scanners in Scan.h with byte-at-a-time loops for words
+// of various lengths.
+static void bench_scan() {
+  static const size_t n = 4096;
+
+  printf("%6s %14s %14s %14s %14s\n", "length", "find_at/byte",
+         "find_at/memchr", (std::string("find_at/") + scan_impl).c_str(),
+         "hex/byte");
+  for (size_t len : {4, 8, 16, 32, 64, 256}) {
+    std::string ident, hex;
+    for (size_t i = 0; i < n; ++i) {
+      ident += std::string(len, 'x') + "@";
+      hex += std::string(len, 'A' + i % 16) + "@";
+    }
+
+    double byte = time_scan(ident, n, find_at_scalar);
+    double libc = time_scan(ident, n, [](const char *p, size_t len) {
+      const char *q = (const char *)memchr(p, '@', len);
+      return q ? q - p : len;
+    });
+    double fast = time_scan(ident, n, find_at);
+    double hex_byte = time_scan(hex, n, count_hex_digits_scalar);
+    double hex_fast = time_scan(hex, n, count_hex_digits);
+    printf("%6zu %11.2f ns %11.2f ns %11.2f ns %11.2f ns (%s %.2f ns)\n",
+           len, byte, libc, fast, hex_byte, scan_impl, hex_fast);
+  }
+}
+
+// Demangles the corpus with a single thread, timing each symbol, and
+// prints throughput, latency percentiles, and memory usage per symbol.
+static void bench_corpus(const std::vector<String> &syms) {
+  Demangler demangler;
+  std::vector<double> times(syms.size());
+  size_t errors = 0;
+  size_t arena_total = 0;
+  size_t arena_max = 0;
+
+  auto run = [&](bool timed) {
+    for (size_t i = 0; i < syms.size(); ++i) {
+      auto start = std::chrono::steady_clock::now();
+      demangler.reset(syms[i]);
+      demangler.parse();
+      if (!demangler.error)
+        demangler.view();
+      if (!timed)
+        continue;
+      times[i] = std::chrono::duration<double, std::nano>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+      if (demangler.error)
+        errors++;
+      arena_total += demangler.arena_bytes();
+      arena_max = std::max(arena_max, demangler.arena_bytes());
+    }
+  };
+
+  // The first pass warms up buffers of the demangler.
+  size_t allocs = num_allocs;
+  run(false);
+  size_t cold_allocs = num_allocs - allocs;
+
+  double start = now();
+  allocs = num_allocs;
+  run(true);
+  allocs = num_allocs - allocs;
+  double elapsed = now() - start;
+
+  std::vector<double> sorted = times;
+  std::sort(sorted.begin(), sorted.end());
+  auto percentile = [&](double p) {
+    return sorted[std::min(sorted.size() - 1, (size_t)(sorted.size() * p))];
+  };
+
+  printf("%zu symbols, %zu errors\n", syms.size(), errors);
+  printf("%14.0f symbols/sec\n", syms.size() / elapsed);
+  printf("ns/symbol: p50 %.0f, p90 %.0f, p99 %.0f, p99.9 %.0f, max %.0f\n",
+         percentile(0.5), percentile(0.9), percentile(0.99),
+         percentile(0.999), sorted.back());
+  printf("arena bytes/symbol: avg %.1f, max %zu\n",
+         (double)arena_total / syms.size(), arena_max);
+  printf("heap allocations/symbol: %.4f (first pass %.4f)\n",
+         (double)allocs / syms.size(), (double)cold_allocs / syms.size());
+}
+
+// Hashes tokens of demangled names with FNV-1a.
+class HashSink : public Sink {
+public:
+  void append(TokenKind, String s) override {
+    for (size_t i = 0; i < s.len; ++i)
+      hash = (hash ^ (uint8_t)s.p[i]) * 0x100000001b3;
+  }
+
+  uint64_t hash = 0xcbf29ce484222325;
+};
+
+// Compares ways to process the corpus with parse() followed by view():
+// parse() alone, writing to a hashing sink, demangling with NameOnly,
+// and validate().
+static void bench_modes(const std::vector<String> &syms) {
+  Demangler demangler;
+  Demangler::SymbolInfo info;
+  size_t valid = 0;
+
+  auto time = [&](const char *name, auto fn) {
+    fn(); // warm up
+    valid = 0;
+    double start = now();
+    fn();
+    printf("%-20s %10.1f\n", name, (now() - start) * 1e9 / syms.size());
+  };
+
+  printf("%-20s %10s\n", "mode", "ns/symbol");
+  time("parse+view", [&] {
+    for (String s : syms) {
+      demangler.reset(s);
+      demangler.parse();
+      if (!demangler.error)
+        demangler.view();
+    }
+  });
+  time("parse", [&] {
+    for (String s : syms) {
+      demangler.reset(s);
+      demangler.parse();
+    }
+  });
+  time("parse+write", [&] {
+    HashSink sink;
+    for (String s : syms) {
+      demangler.reset(s);
+      demangler.parse();
+      if (!demangler.error)
+        demangler.write(sink);
+    }
+  });
+  time("name only", [&] {
+    demangler.set_flags(NameOnly);
+    for (String s : syms) {
+      demangler.reset(s);
+      demangler.parse();
+      if (!demangler.error)
+        demangler.view();
+    }
+    demangler.set_flags(0);
+  });
+  time("validate", [&] {
+    for (String s : syms)
+      valid += demangler.validate(s, info);
+  });
+  printf("%zu of %zu symbols valid\n", valid, syms.size());
+}
+
+// Runs TextFilter over a linker log mentioning each symbol of the
+// corpus, and compares its throughput with that of memcpy().
+static void bench_filter(const std::vector<String> &syms) {
+  std::string text;
+  for (String s : syms) {
+    text += "error LNK2019: unresolved external symbol \"";
+    text.append(s.p, s.len);
+    text += "\" referenced in function main\n";
+  }
+
+  std::string out;
+  out.reserve(text.size() * 2);
+  Demangler demangler;
+  TextFilter filter(demangler);
+
+  double start = now();
+  out.assign(text);
+  double copy = now() - start;
+
+  out.clear();
+  filter.filter(text, out);
+  out.clear();
+  start = now();
+  filter.filter(text, out);
+  double elapsed = now() - start;
+
+  // The same text without symbols shows the cost of scanning.
+  std::replace(text.begin(), text.end(), '?', '#');
+  out.clear();
+  start = now();
+  filter.filter(text, out);
+  double scan = now() - start;
+
+  double mb = text.size() / 1e6;
+  printf("%.1f MB of text\n", mb);
+  printf("%-20s %10.1f MB/s\n", "copy", mb / copy);
+  printf("%-20s %10.1f MB/s\n", "filter", mb / elapsed);
+  printf("%-20s %10.1f MB/s\n", "filter (no symbols)", mb / scan);
+}
+
+// Returns member functions of STL-like class templates, sorted as in
+// symbol dumps. Each function has several overloads, whose symbols
+// share the name.
+static std::vector<std::string> stl_symbols() {
+  static const char *args[] = {
+      "H", "M", "_K", "PEAX",
+      "V?$basic_string@DU?$char_traits@D@std@@V?$allocator@D@2@@std@@",
+      "V?$shared_ptr@VWidget@llvm@@@std@@"};
+  static const char *methods[] = {"begin", "end", "find", "insert",
+                                  "erase", "size", "push_back", "assign"};
+  static const char *sigs[] = {"QEAA_KXZ", "QEBA_KXZ", "QEAAXAEBH@Z",
+                               "QEAAX_KAEBH@Z", "QEAAXPEBH0@Z",
+                               "QEAA_NAEBV01@@Z"};
+
+  std::vector<std::string> v;
+  for (const char *a : args) {
+    for (const char *b : args) {
+      std::string cls = std::string("?$map@") + a + b + "@std@@";
+      for (const char *m : methods)
+        for (const char *sig : sigs)
+          v.push_back(std::string("?") + m + "@" + cls + sig);
+    }
+  }
+  std::sort(v.begin(), v.end());
+  return v;
+}
+
+// Demangles sorted symbols with and without incremental mode.
+static void bench_sorted(const std::vector<String> &syms) {
+  std::vector<std::string> corpus;
+  for (String s : syms)
+    corpus.push_back(s.str());
+  std::sort(corpus.begin(), corpus.end());
+
+  // The STL symbols are repeated so that they take as long as the
+  // corpus.
+  std::vector<std::string> stl;
+  std::vector<std::string> v = stl_symbols();
+  while (stl.size() < corpus.size())
+    stl.insert(stl.end(), v.begin(), v.end());
+
+  auto time = [](const std::vector<std::string> &syms, bool incremental) {
+    Demangler demangler;
+    demangler.set_incremental(incremental);
+    double best = 1e30;
+    for (int i = 0; i < 3; ++i) {
+      double start = now();
+      for (const std::string &s : syms) {
+        demangler.reset(s);
+        demangler.parse();
+        if (!demangler.error)
+          demangler.view();
+      }
+      best = std::min(best, now() - start);
+    }
+    return best * 1e9 / syms.size();
+  };
+
+  printf("%-20s %10s %12s\n", "sorted input", "ns/symbol", "incremental");
+  printf("%-20s %10.1f %12.1f\n", "corpus", time(corpus, false),
+         time(corpus, true));
+  printf("%-20s %10.1f %12.1f\n", "STL members", time(stl, false),
+         time(stl, true));
+}
+
+// Returns an estimate of the memory used by a std::string with glibc's
+// malloc, which adds 8 bytes to a block and rounds it up to 16 bytes.
+static size_t string_memory(const std::string &s) {
+  if (s.capacity() < sizeof(std::string) / 2)
+    return sizeof(std::string);
+  return sizeof(std::string) + std::max<size_t>(32, (s.size() + 24) & ~15);
+}
+
+// Compares memory used to keep demangled names as std::strings and in
+// StringPools with different options.
+static void bench_pool(const std::vector<String> &syms) {
+  std::vector<std::string> corpus;
+  Demangler demangler;
+  for (String s : syms) {
+    demangler.reset(s);
+    demangler.parse();
+    corpus.push_back(demangler.error ? s.str() : demangler.str());
+  }
+
+  std::vector<std::string> stl;
+  for (const std::string &s : stl_symbols()) {
+    demangler.reset(s);
+    demangler.parse();
+    stl.push_back(demangler.str());
+  }
+
+  printf("%-20s %12s %12s %12s %12s\n", "bytes/string", "std::string",
+         "pool", "dedup", "prefixes");
+  for (auto *v : {&corpus, &stl}) {
+    size_t bytes = 0;
+    for (const std::string &s : *v)
+      bytes += string_memory(s);
+    printf("%-20s %12.1f", v == &stl ? "STL members" : "corpus",
+           (double)bytes / v->size());
+
+    for (int mode = 0; mode < 3; ++mode) {
+      StringPool::Options opts;
+      opts.dedup = mode >= 1;
+      opts.share_prefixes = mode >= 2;
+      StringPool pool(opts);
+      std::vector<StringPool::Handle> handles;
+      for (const std::string &s : *v)
+        handles.push_back(pool.add(s));
+
+      std::string tmp;
+      for (size_t i = 0; i < v->size(); ++i) {
+        tmp.clear();
+        pool.get(handles[i], tmp);
+        if (tmp != (*v)[i]) {
+          printf("\nStringPool returned a wrong string: %s\n", tmp.c_str());
+          exit(1);
+        }
+      }
+
+      // Pages are counted by their used bytes so that the small sets
+      // here are not dominated by the unused part of the last page.
+      const StringPool::Stats &st = pool.stats();
+      size_t mem = st.record_bytes + st.table_bytes +
+                   handles.size() * sizeof(StringPool::Handle);
+      printf(" %12.1f", (double)mem / v->size());
+    }
+    printf("\n");
+  }
+}
+
+// Compares demangling all symbols up front with creating a SymbolTable
+// and demangling only some of them, as a symbolizer showing a few
+// percent of symbols would.
+static void bench_lazy(const std::vector<String> &syms) {
+  double start = now();
+  std::string out;
+  Demangler demangler;
+  demangle_lines(demangler, syms.data(), syms.size(), out);
+  double eager = now() - start;
+
+  start = now();
+  SymbolTable table(syms);
+  double create = now() - start;
+
+  SymbolTable::Options opts;
+  opts.validate = false;
+  start = now();
+  SymbolTable unchecked(syms, opts);
+  double create_unchecked = now() - start;
+
+  // Look up every 50th symbol twice. The second lookup reads the pool.
+  double lookup[2];
+  for (double &t : lookup) {
+    start = now();
+    for (size_t i = 0; i < syms.size(); i += 50) {
+      out.clear();
+      table.name(i, out);
+    }
+    t = now() - start;
+  }
+
+  printf("%-20s %10s\n", "lazy demangling", "ms");
+  printf("%-20s %10.1f\n", "demangle all", eager * 1e3);
+  printf("%-20s %10.1f\n", "SymbolTable", create * 1e3);
+  printf("%-20s %10.1f\n", "  without validate", create_unchecked * 1e3);
+  printf("%-20s %10.1f\n", "first 2% lookups", lookup[0] * 1e3);
+  printf("%-20s %10.1f\n", "second 2% lookups", lookup[1] * 1e3);
+}
+
+// Demangles the corpus with 1, 2, 4, ... threads up to the number of
+// hardware threads and prints throughput and speedup for each.
+static void bench_scaling(const std::vector<String> &syms) {
+  unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string out;
+  double base = 0;
+
+  printf("%8s %14s %8s\n", "threads", "symbols/sec", "speedup");
+  for (unsigned t = 1;; t = std::min(t * 2, max_threads)) {
+    out.clear();
+    double start = now();
+    demangle_lines_parallel(syms, t, out);
+    double rate = syms.size() / (now() - start);
+    if (t == 1)
+      base = rate;
+    printf("%8u %14.0f %7.2fx\n", t, rate, rate / base);
+    if (t == max_threads)
+      break;
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 && std::string(argv[1]) == "--generate") {
+    if (argc < 3 || argc > 4) {
+      fprintf(stderr, "Usage: %s --generate <n> [<seed>]\n", argv[0]);
+      return 1;
+    }
+    unsigned seed = (argc == 4) ? atoi(argv[3]) : 1;
+    for (const std::string &s : generate(strtoull(argv[2], nullptr, 10), seed))
+      printf("%s\n", s.c_str());
+    return 0;
+  }
+
+  std::vector<std::string> corpus = load_corpus(argc > 1 ? argv[1] : nullptr);
+  std::vector<String> syms(corpus.begin(), corpus.end());
+
+  bench_micro();
+  printf("\n");
+  bench_scan();
+  printf("\n");
+  bench_corpus(syms);
+  printf("\n");
+  bench_modes(syms);
+  printf("\n");
+  bench_filter(syms);
+  printf("\n");
+  bench_sorted(syms);
+  printf("\n");
+  bench_pool(syms);
+  printf("\n");
+  bench_lazy(syms);
+  printf("\n");
+  bench_scaling(syms);
+  return 0;
+}
@@ -0,0 +1,312 @@
+//===- casetest.cpp -------------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Checks test cases in-process and times them.
+//
+// Usage: casetest [options] <cases>
+//
+// A cases file has a mangled name and its expected demangled form on
+// each line, separated by a tab. If the expected form starts with
+// "error: ", the rest is the expected error message. A line "[name]"
+// starts a category, and lines starting with '#' are comments.
+//
+// Each case is demangled and checked with Demangler::str(), write()
+// and validate(), and the program fails if a case fails.
+//
+// If a baseline or an output file for timings is given, each case is
+// also timed. The cost of a category is the average time of its cases
+// divided by the mean of the averages of all categories, so that costs
+// do not depend on the speed of the machine or on the build mode. The
+// program fails if the cost of a category becomes larger than in the
+// baseline by more than a given factor. A change that slows down all
+// categories alike is not detected; use the benchmark for that.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MicrosoftDemangle.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+using namespace ms_demangle;
+
+namespace {
+struct Case {
+  std::string category;
+  std::string sym;
+  std::string expected;
+  bool error;
+  double ns = 0;
+};
+
+// Concatenates tokens of a demangled name.
+class StringSink : public Sink {
+public:
+  void append(TokenKind, String s) override { out.append(s.p, s.len); }
+  std::string out;
+};
+} // namespace
+
+static void usage(const char *argv0) {
+  std::cout << "Usage: " << argv0 << " [options] <cases>\n"
+            << "\n"
+            << "Options:\n"
+            << "  --baseline <file>   Compare costs of categories with a "
+            << "baseline\n"
+            << "  --threshold <x>     Fail if a category costs more than x "
+            << "times as much as\n"
+            << "                      in the baseline (default 1.5)\n"
+            << "  --write-baseline <file>\n"
+            << "                      Write costs of categories as a new "
+            << "baseline\n"
+            << "  --timings <file>    Write the time of each case\n";
+  exit(1);
+}
+
+static bool read_cases(const char *path, std::vector<Case> &cases) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << path << ": cannot open\n";
+    return false;
+  }
+
+  std::string category = "default";
+  int lineno = 0;
+  for (std::string line; std::getline(in, line);) {
+    ++lineno;
+    if (line.empty() || line[0] == '#')
+      continue;
+    if (line[0] == '[' && line.back() == ']') {
+      category = line.substr(1, line.size() - 2);
+      continue;
+    }
+
+    size_t tab = line.find('\t');
+    if (tab == line.npos) {
+      std::cerr << path << ":" << lineno << ": tab expected\n";
+      return false;
+    }
+    Case c;
+    c.category = category;
+    c.sym = line.substr(0, tab);
+    c.expected = line.substr(tab + 1);
+    c.error = c.expected.compare(0, 7, "error: ") == 0;
+    if (c.error)
+      c.expected.erase(0, 7);
+    cases.push_back(c);
+  }
+  return true;
+}
+
+// Returns an empty string if a case passes, or what went wrong.
+static std::string check(Demangler &demangler, const Case &c) {
+  demangler.reset(c.sym);
+  demangler.parse();
+  std::string actual = demangler.error ? "" : demangler.str();
+  std::string error = demangler.error ? demangler.error_message() : "";
+
+  if (c.error && !demangler.error)
+    return "error expected, but got " + actual;
+  if (c.error && error != c.expected)
+    return c.expected + " expected, but got " + error;
+  if (!c.error && demangler.error)
+    return c.expected + " expected, but got error: " + error;
+  if (!c.error && actual != c.expected)
+    return c.expected + " expected, but got " + actual;
+
+  // Demangler::write() must give the same text as str().
+  if (!c.error) {
+    demangler.reset(c.sym);
+    demangler.parse();
+    StringSink sink;
+    demangler.write(sink);
+    if (sink.out != actual)
+      return "tokens differ: " + sink.out;
+  }
+
+  // validate() must find the same errors, except that it does not
+  // render names and hence cannot find that they are too long.
+  Demangler::SymbolInfo info;
+  bool valid = demangler.validate(c.sym, info);
+  if (!c.error && !valid)
+    return "validate() rejected it: " + demangler.error_message();
+  if (c.error && demangler.error_message() != c.expected)
+    return "validate(): " + c.expected + " expected, but got " +
+           demangler.error_message();
+  return "";
+}
+
+// Returns the shortest time in nanoseconds to demangle a case, out of
+// several rounds of many iterations each.
+static double time_case(Demangler &demangler, const Case &c) {
+  using namespace std::chrono;
+  const int rounds = 5;
+  const int iterations = 200;
+
+  double best = 1e30;
+  for (int i = 0; i < rounds; ++i) {
+    auto start = steady_clock::now();
+    for (int j = 0; j < iterations; ++j) {
+      demangler.reset(c.sym);
+      demangler.parse();
+      if (!demangler.error)
+        demangler.view();
+    }
+    duration<double, std::nano> ns = steady_clock::now() - start;
+    best = std::min(best, ns.count() / iterations);
+  }
+  return best;
+}
+
+// Reads a baseline, which has a category and its cost on each line,
+// separated by a tab.
+static bool read_baseline(const char *path,
+                          std::map<std::string, double> &baseline) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << path << ": cannot open\n";
+    return false;
+  }
+  for (std::string line; std::getline(in, line);) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    size_t tab = line.find('\t');
+    if (tab == line.npos) {
+      std::cerr << path << ": tab expected: " << line << "\n";
+      return false;
+    }
+    baseline[line.substr(0, tab)] = atof(line.c_str() + tab + 1);
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  const char *baseline_path = nullptr;
+  const char *new_baseline_path = nullptr;
+  const char *timings_path = nullptr;
+  double threshold = 1.5;
+
+  int i = 1;
+  for (; i < argc && argv[i][0] == '-'; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 == argc)
+      usage(argv[0]);
+    if (arg == "--baseline")
+      baseline_path = argv[++i];
+    else if (arg == "--threshold")
+      threshold = atof(argv[++i]);
+    else if (arg == "--write-baseline")
+      new_baseline_path = argv[++i];
+    else if (arg == "--timings")
+      timings_path = argv[++i];
+    else
+      usage(argv[0]);
+  }
+  if (i + 1 != argc || threshold <= 0)
+    usage(argv[0]);
+
+  std::vector<Case> cases;
+  if (!read_cases(argv[i], cases))
+    return 1;
+
+  Demangler demangler;
+  int failures = 0;
+  for (const Case &c : cases) {
+    std::string msg = check(demangler, c);
+    if (!msg.empty()) {
+      std::cout << c.sym << ": " << msg << "\n";
+      failures++;
+    }
+  }
+  if (failures) {
+    std::cout << failures << " of " << cases.size() << " cases failed\n";
+    return 1;
+  }
+
+  if (!baseline_path && !new_baseline_path && !timings_path) {
+    printf("%zu cases passed\n", cases.size());
+    return 0;
+  }
+
+  // Categories in the order they appear.
+  std::vector<std::string> categories;
+  std::map<std::string, double> total;
+  std::map<std::string, int> count;
+  for (Case &c : cases) {
+    c.ns = time_case(demangler, c);
+    if (!count[c.category]++)
+      categories.push_back(c.category);
+    total[c.category] += c.ns;
+  }
+
+  if (timings_path) {
+    std::ofstream out(timings_path);
+    for (const Case &c : cases)
+      out << c.category << "\t" << c.sym << "\t" << c.ns << "\n";
+  }
+
+  // Average ns/case and cost of each category.
+  std::map<std::string, double> avg;
+  std::map<std::string, double> cost;
+  double mean = 0;
+  for (const std::string &cat : categories) {
+    avg[cat] = total[cat] / count[cat];
+    mean += avg[cat] / categories.size();
+  }
+  for (const std::string &cat : categories)
+    cost[cat] = avg[cat] / mean;
+
+  if (new_baseline_path) {
+    std::ofstream out(new_baseline_path);
+    out << "# Average time of cases of each category in " << argv[i]
+        << ",\n"
+        << "# divided by the mean of all categories.\n"
+        << "# Run \"make baseline\" to update.\n";
+    for (const std::string &cat : categories) {
+      char buf[32];
+      snprintf(buf, sizeof(buf), "%.2f", cost[cat]);
+      out << cat << "\t" << buf << "\n";
+    }
+  }
+
+  std::map<std::string, double> baseline;
+  if (baseline_path && !read_baseline(baseline_path, baseline))
+    return 1;
+
+  int regressions = 0;
+  printf("%-24s %6s %10s %6s %8s\n", "category", "cases", "ns/case", "cost",
+         "baseline");
+  for (const std::string &cat : categories) {
+    printf("%-24s %6d %10.1f %6.2f", cat.c_str(), count[cat], avg[cat],
+           cost[cat]);
+    auto it = baseline.find(cat);
+    if (it == baseline.end()) {
+      printf("\n");
+      continue;
+    }
+    printf(" %8.2f", it->second);
+    if (cost[cat] > it->second * threshold) {
+      printf("  regressed by more than %gx", threshold);
+      regressions++;
+    }
+    printf("\n");
+  }
+
+  printf("%zu cases passed\n", cases.size());
+  if (regressions) {
+    printf("%d categories regressed\n", regressions);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,419 @@
+//===- compare.cpp --------------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Compares this demangler with other MSVC demanglers.
+//
+// Usage: comparebench [options] [<corpus>]
+//
+// A corpus is a file containing mangled symbols one per line, and stdin
+// is read if none is given. Each demangler demangles the corpus in the
+// same process, and the program reports for each of them:
+//
+//   - throughput, the best of several rounds over the whole corpus;
+//   - percentiles of the time to demangle a symbol;
+//   - heap allocations (operator new only) per symbol;
+//   - peak memory, i.e. how much the maximum resident set size grows
+//     while a fresh instance demangles the corpus in a child process;
+//   - how many results differ from this demangler's.
+//
+// Other demanglers are compiled in if available:
+//
+//   llvm::microsoftDemangle()  if HAVE_LLVM_DEMANGLE is defined
+//                              ("make compare LLVM_CONFIG=llvm-config")
+//   UnDecorateSymbolName()     on Windows
+//
+// This demangler never writes access specifiers, "virtual", "static" or
+// calling conventions, puts no space after '*', '&' and ',', and writes
+// "int64_t" instead of "__int64", so results are also compared after
+// normalizing these differences.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MicrosoftDemangle.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#ifdef HAVE_LLVM_DEMANGLE
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Demangle/Demangle.h"
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#include <dbghelp.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "dbghelp.lib")
+#endif
+#else
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace ms_demangle;
+
+// Heap allocations are counted to compare how often demanglers
+// allocate memory.
+static std::atomic<size_t> num_allocs(0);
+
+void *operator new(size_t size) {
+  num_allocs.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+namespace {
+// A demangler to compare. Symbols are NUL-terminated because some of
+// the demanglers need that.
+class Engine {
+public:
+  virtual ~Engine() = default;
+
+  // Sets out to the demangled form of sym and returns true, or returns
+  // false if sym cannot be demangled. out is valid until the next call.
+  virtual bool demangle(const std::string &sym, String &out) = 0;
+};
+
+class MsDemangleEngine : public Engine {
+public:
+  bool demangle(const std::string &sym, String &out) override {
+    demangler.reset(sym);
+    demangler.parse();
+    if (demangler.error)
+      return false;
+    out = demangler.view();
+    return !demangler.error;
+  }
+
+private:
+  Demangler demangler;
+};
+
+#ifdef HAVE_LLVM_DEMANGLE
+// Up to LLVM 16, the output buffer is reused. microsoftDemangle() grows
+// it with realloc() and sets n to the length of the result, which is
+// never larger than the buffer. LLVM 17 takes a std::string_view and
+// returns a new buffer for each symbol, which is freed by the next call.
+class LlvmEngine : public Engine {
+public:
+  ~LlvmEngine() override { free(buf); }
+
+  bool demangle(const std::string &sym, String &out) override {
+    int status;
+#if LLVM_VERSION_MAJOR >= 17
+    free(buf);
+    buf = llvm::microsoftDemangle(sym, nullptr, &status);
+    char *p = buf;
+#else
+    size_t n = cap;
+    char *p = llvm::microsoftDemangle(sym.c_str(), nullptr, buf, &n, &status);
+    if (p) {
+      buf = p;
+      cap = std::max(cap, n);
+    }
+#endif
+    if (!p || status != llvm::demangle_success)
+      return false;
+    out = String(p, strlen(p));
+    return true;
+  }
+
+private:
+  char *buf = nullptr;
+  size_t cap = 0;
+};
+#endif
+
+#ifdef _WIN32
+// UnDecorateSymbolName() returns the symbol itself if it cannot be
+// demangled.
+class DbgHelpEngine : public Engine {
+public:
+  bool demangle(const std::string &sym, String &out) override {
+    DWORD n = UnDecorateSymbolName(sym.c_str(), buf, sizeof(buf),
+                                   UNDNAME_COMPLETE);
+    if (n == 0 || sym == buf)
+      return false;
+    out = String(buf, n);
+    return true;
+  }
+
+private:
+  char buf[4096];
+};
+#endif
+
+struct EngineInfo {
+  const char *name;
+  Engine *(*create)();
+};
+} // namespace
+
+static const EngineInfo engines[] = {
+    {"ms_demangle", [] { return (Engine *)new MsDemangleEngine; }},
+#ifdef HAVE_LLVM_DEMANGLE
+    {"llvm", [] { return (Engine *)new LlvmEngine; }},
+#endif
+#ifdef _WIN32
+    {"dbghelp", [] { return (Engine *)new DbgHelpEngine; }},
+#endif
+};
+
+static void usage(const char *argv0) {
+  std::cout << "Usage: " << argv0 << " [options] [<corpus>]\n"
+            << "\n"
+            << "Options:\n"
+            << "  --rounds <n>    Demangle the corpus n times and report "
+            << "the best (default 3)\n"
+            << "  --diffs <n>     Print up to n differing results per "
+            << "demangler (default 5)\n";
+  exit(1);
+}
+
+static bool read_corpus(const char *path, std::vector<std::string> &v) {
+  FILE *in = stdin;
+  if (path && !(in = fopen(path, "r"))) {
+    std::cerr << path << ": cannot open\n";
+    return false;
+  }
+  char buf[8192];
+  while (fgets(buf, sizeof(buf), in)) {
+    std::string s = buf;
+    while (!s.empty() && (s.back() == '\n' || s.back() == '\r'))
+      s.pop_back();
+    if (!s.empty())
+      v.push_back(s);
+  }
+  if (path)
+    fclose(in);
+  return true;
+}
+
+static double now() {
+  using namespace std::chrono;
+  return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+namespace {
+struct Result {
+  std::string text;
+  bool ok;
+};
+} // namespace
+
+// Demangles all symbols and returns the results.
+static std::vector<Result> run(Engine &e,
+                               const std::vector<std::string> &syms) {
+  std::vector<Result> v;
+  for (const std::string &s : syms) {
+    String out;
+    bool ok = e.demangle(s, out);
+    v.push_back({ok ? out.str() : s, ok});
+  }
+  return v;
+}
+
+// Returns the growth of the peak resident set size in KiB while a new
+// instance of an engine demangles all symbols, or -1 if unknown. This
+// is measured in a child process, so that memory used by other engines
+// and freed memory kept by malloc do not count.
+static long peak_memory(const EngineInfo &info,
+                        const std::vector<std::string> &syms) {
+#ifdef _WIN32
+  return -1;
+#else
+  int fds[2];
+  if (pipe(fds) != 0)
+    return -1;
+
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0)
+    return -1;
+  if (pid == 0) {
+    rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    std::unique_ptr<Engine> e(info.create());
+    for (const std::string &s : syms) {
+      String out;
+      e->demangle(s, out);
+    }
+    getrusage(RUSAGE_SELF, &after);
+    long kb = after.ru_maxrss - before.ru_maxrss;
+    ssize_t n = write(fds[1], &kb, sizeof(kb));
+    _exit(n == sizeof(kb) ? 0 : 1);
+  }
+
+  close(fds[1]);
+  long kb = -1;
+  if (read(fds[0], &kb, sizeof(kb)) != sizeof(kb))
+    kb = -1;
+  close(fds[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  return kb;
+#endif
+}
+
+// Removes what this demangler never writes and whitespace, and spells
+// 64-bit integer types as this demangler does.
+static std::string normalize(const std::string &s) {
+  static const char *const words[][2] = {
+      {"public: ", ""},    {"private: ", ""},
+      {"protected: ", ""}, {"virtual ", ""},
+      {"static ", ""},     {"__cdecl", ""},
+      {"__stdcall", ""},   {"__thiscall", ""},
+      {"__fastcall", ""},  {"__vectorcall", ""},
+      {"__clrcall", ""},   {"__eabi", ""},
+      {"__regcall", ""},   {"__ptr64", ""},
+      {"unsigned __int64", "uint64_t"},
+      {"__int64", "int64_t"},
+  };
+
+  std::string t = s;
+  for (const auto &w : words) {
+    size_t len = strlen(w[0]);
+    for (size_t pos = 0; (pos = t.find(w[0], pos)) != t.npos;) {
+      t.replace(pos, len, w[1]);
+      pos += strlen(w[1]);
+    }
+  }
+  t.erase(std::remove(t.begin(), t.end(), ' '), t.end());
+  return t;
+}
+
+int main(int argc, char **argv) {
+  int rounds = 3;
+  size_t max_diffs = 5;
+
+  int i = 1;
+  for (; i < argc && argv[i][0] == '-' && argv[i][1]; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 == argc)
+      usage(argv[0]);
+    if (arg == "--rounds")
+      rounds = std::max(1, atoi(argv[++i]));
+    else if (arg == "--diffs")
+      max_diffs = strtoul(argv[++i], nullptr, 10);
+    else
+      usage(argv[0]);
+  }
+  if (i + 1 < argc)
+    usage(argv[0]);
+
+  const char *path = nullptr;
+  if (i < argc && strcmp(argv[i], "-") != 0)
+    path = argv[i];
+
+  std::vector<std::string> syms;
+  if (!read_corpus(path, syms))
+    return 1;
+  if (syms.empty()) {
+    std::cerr << "empty corpus\n";
+    return 1;
+  }
+
+  size_t bytes = 0;
+  for (const std::string &s : syms)
+    bytes += s.size();
+  printf("%zu symbols, %zu bytes\n\n", syms.size(), bytes);
+
+  printf("%-12s %10s %8s %8s %8s %8s %8s %10s %10s %8s\n", "demangler",
+         "Msym/s", "MB/s", "p50 ns", "p90 ns", "p99 ns", "max ns",
+         "allocs/sym", "peak KiB", "failed");
+
+  std::vector<std::vector<Result>> results;
+  for (const EngineInfo &info : engines) {
+    std::unique_ptr<Engine> e(info.create());
+    results.push_back(run(*e, syms));
+    size_t failures = 0;
+    for (const Result &r : results.back())
+      failures += !r.ok;
+
+    double best = 1e30;
+    size_t allocs = 0;
+    for (int r = 0; r < rounds; ++r) {
+      size_t start_allocs = num_allocs;
+      double start = now();
+      for (const std::string &s : syms) {
+        String out;
+        e->demangle(s, out);
+      }
+      best = std::min(best, now() - start);
+      allocs = num_allocs - start_allocs;
+    }
+
+    // Time each symbol separately. This includes the time to read the
+    // clock, which is why throughput is measured separately.
+    std::vector<double> ns;
+    ns.reserve(syms.size());
+    for (const std::string &s : syms) {
+      String out;
+      double start = now();
+      e->demangle(s, out);
+      ns.push_back((now() - start) * 1e9);
+    }
+    std::sort(ns.begin(), ns.end());
+    auto pct = [&](double p) { return ns[(size_t)(p * (ns.size() - 1))]; };
+
+    long kb = peak_memory(info, syms);
+    printf("%-12s %10.2f %8.1f %8.0f %8.0f %8.0f %8.0f %10.2f ", info.name,
+           syms.size() / best / 1e6, bytes / best / 1e6, pct(0.5), pct(0.9),
+           pct(0.99), ns.back(), (double)allocs / syms.size());
+    if (kb < 0)
+      printf("%10s", "-");
+    else
+      printf("%10ld", kb);
+    printf(" %8zu\n", failures);
+  }
+
+  // Results of other engines are compared with the first one's. Only
+  // symbols that both demangled are printed.
+  for (size_t e = 1; e < results.size(); ++e) {
+    size_t only_first = 0;
+    size_t only_this = 0;
+    size_t exact = 0;
+    std::vector<size_t> diffs;
+    for (size_t j = 0; j < syms.size(); ++j) {
+      const Result &a = results[0][j];
+      const Result &b = results[e][j];
+      if (a.ok != b.ok) {
+        only_first += a.ok;
+        only_this += b.ok;
+      } else if (a.text != b.text) {
+        exact++;
+        if (normalize(a.text) != normalize(b.text))
+          diffs.push_back(j);
+      }
+    }
+
+    printf("\n%s: %zu symbols demangled only by %s, %zu only by %s\n",
+           engines[e].name, only_first, engines[0].name, only_this,
+           engines[e].name);
+    printf("%s: %zu other results differ, %zu after normalization\n",
+           engines[e].name, exact, diffs.size());
+    for (size_t j = 0; j < diffs.size() && j < max_diffs; ++j) {
+      size_t k = diffs[j];
+      printf("  %s\n    %-12s %s\n    %-12s %s\n", syms[k].c_str(),
+             engines[0].name, results[0][k].text.c_str(), engines[e].name,
+             results[e][k].text.c_str());
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,572 @@
+//===- undname.cpp --------------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A command line tool to demangle MSVC-style mangled symbols.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Batch.h"
+#include "CoffReader.h"
+#include "Filter.h"
+#include "Index.h"
+#include "MicrosoftDemangle.h"
+#include "ResultCache.h"
+#include "StringPool.h"
+#include "SymbolTable.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+using namespace ms_demangle;
+
+// Command line options.
+static struct {
+  unsigned threads = 1;
+  std::unique_ptr<ResultCache> cache;
+  size_t name_cache_size = 0;
+  Demangler::Limits limits;
+  uint8_t flags = 0;
+  bool incremental = false;
+  bool stats = false;
+  bool validate = false;
+  bool tokens = false;
+  bool filter = false;
+  bool lazy = false;
+  std::unique_ptr<StringPool> pool;
+
+  // Totals of SymbolTables used by --lazy.
+  size_t lazy_symbols = 0;
+  size_t lazy_demangled = 0;
+  size_t lazy_failed = 0;
+  size_t lazy_memory = 0;
+} config;
+
+static std::unique_ptr<BatchDemangler> batch;
+
+// Demangles symbols and writes results to stdout, one per line.
+static void demangle_and_write(const std::vector<String> &syms,
+                               std::string &out) {
+  out.clear();
+  batch->demangle_lines(syms, out);
+  fwrite(out.data(), 1, out.size(), stdout);
+}
+
+// Reads symbols from a given file, one per line, and writes demangled
+// names to stdout. Symbols that cannot be demangled are printed as-is
+// so that output lines correspond to input lines.
+static void demangle_stream(FILE *in) {
+  batch->demangle_stream(in, stdout);
+}
+
+// Same as demangle_stream(), but keeps all results in a StringPool and
+// writes them out at the end, to show how much memory the pool uses.
+static void pool_stream(FILE *in) {
+  LineReader reader(in);
+  std::vector<String> lines;
+  std::vector<StringPool::Handle> handles;
+  std::string out;
+
+  while (reader.next(lines)) {
+    out.clear();
+    batch->demangle_lines(lines, out);
+    for (String s = out; !s.empty();) {
+      size_t len = std::find(s.p, s.p + s.len, '\n') - s.p;
+      handles.push_back(config.pool->add(s.substr(0, len)));
+      s.trim(len + 1);
+    }
+  }
+
+  for (StringPool::Handle h : handles) {
+    out.clear();
+    config.pool->get(h, out);
+    out += '\n';
+    fwrite(out.data(), 1, out.size(), stdout);
+  }
+}
+
+// Same as demangle_and_write(), but puts symbols in a SymbolTable and
+// prints names from it. With -j, all threads first look up all names
+// at once, starting at different symbols, so that they race to
+// demangle the same symbols. This is to test SymbolTable.
+static void write_lazy(const std::vector<String> &syms, std::string &out) {
+  SymbolTable::Options opts;
+  opts.limits = config.limits;
+  opts.flags = config.flags;
+  opts.pool.dedup = opts.pool.share_prefixes = true;
+  SymbolTable table(syms, opts);
+
+  if (config.threads > 1) {
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < config.threads; ++t) {
+      threads.emplace_back([&, t] {
+        std::string s;
+        for (size_t i = 0; i < syms.size(); ++i) {
+          s.clear();
+          table.name((i + syms.size() * t / config.threads) % syms.size(), s);
+        }
+      });
+    }
+    for (std::thread &t : threads)
+      t.join();
+  }
+
+  out.clear();
+  for (size_t i = 0; i < syms.size(); ++i) {
+    table.name(i, out);
+    out += '\n';
+  }
+  fwrite(out.data(), 1, out.size(), stdout);
+
+  config.lazy_symbols += syms.size();
+  config.lazy_demangled += table.num_demangled();
+  config.lazy_failed += table.num_failed();
+  config.lazy_memory += table.pool_stats().memory();
+}
+
+// Returns a description of a symbol checked by Demangler::validate(),
+// e.g. "member public virtual thiscall".
+static std::string describe(const Demangler::SymbolInfo &info) {
+  static const char *const kinds[] = {"not mangled", "variable", "function",
+                                      "member"};
+  static const char *const classes[] = {"public", "protected", "private",
+                                        "global", "static", "virtual", "far"};
+  static const char *const convs[] = {"cdecl",   "pascal",   "thiscall",
+                                      "stdcall", "fastcall", "regcall"};
+
+  std::string s = kinds[info.kind];
+  if (info.kind == MemberFunction)
+    for (int i = 0; i < 7; ++i)
+      if (info.func_class & (1 << i))
+        s = s + " " + classes[i];
+  if (info.kind == FreeFunction || info.kind == MemberFunction)
+    s = s + " " + convs[info.calling_conv];
+  return s;
+}
+
+// Prints tokens of a demangled name, one per line, along with their
+// kinds.
+class TokenPrinter : public Sink {
+public:
+  void append(TokenKind kind, String s) override {
+    static const char *const kinds[] = {"identifier", "scope",  "keyword",
+                                        "operator",   "number", "punct",
+                                        "space"};
+    out += kinds[kind];
+    out += " '";
+    out.append(s.p, s.len);
+    out += "'\n";
+  }
+
+  std::string out;
+};
+
+// Checks symbols read from a given file, one per line, and writes their
+// kinds or "invalid" to stdout.
+static void validate_stream(FILE *in) {
+  LineReader reader(in);
+  std::vector<String> lines;
+  Demangler demangler;
+  demangler.set_limits(config.limits);
+  Demangler::SymbolInfo info;
+  std::string out;
+
+  while (reader.next(lines)) {
+    out.clear();
+    for (String sym : lines) {
+      out += demangler.validate(sym, info) ? describe(info) : "invalid";
+      out += '\n';
+    }
+    fwrite(out.data(), 1, out.size(), stdout);
+  }
+}
+
+// Reads all lines of a file into buf and returns them.
+static std::vector<String> read_lines(FILE *in, std::string &buf) {
+  char tmp[65536];
+  while (size_t n = fread(tmp, 1, sizeof(tmp), in))
+    buf.append(tmp, n);
+
+  std::vector<String> lines;
+  String s = buf;
+  while (!s.empty()) {
+    size_t len = std::find(s.p, s.p + s.len, '\n') - s.p;
+    String line = s.substr(0, len);
+    if (line.len && line.p[line.len - 1] == '\r')
+      line.len--;
+    lines.push_back(line);
+    s.trim(std::min(len + 1, s.len));
+  }
+  return lines;
+}
+
+// Prints entries of an index whose demangled names equal a given name
+// or start with it, as mangled and demangled names separated by a tab.
+static int lookup(const char *path, const char *name, bool prefix) {
+  Index index;
+  std::string error;
+  if (!index.open(path, error)) {
+    std::cerr << path << ": " << error << "\n";
+    return 1;
+  }
+
+  std::string out;
+  auto print = [&](String demangled, String mangled) {
+    out.append(mangled.p, mangled.len);
+    out += '\t';
+    out.append(demangled.p, demangled.len);
+    out += '\n';
+  };
+  if (prefix)
+    index.find_prefix({name, strlen(name)}, print);
+  else
+    index.find({name, strlen(name)}, print);
+  fwrite(out.data(), 1, out.size(), stdout);
+  return 0;
+}
+
+// Demangles all symbol names in COFF object files, archives or PE
+// images and writes them to stdout, one per line.
+static int demangle_coff(char **paths, int n) {
+  std::vector<String> syms;
+  std::string out;
+
+  for (int i = 0; i < n; ++i) {
+    MappedFile file;
+    if (!file.open(paths[i])) {
+      std::cerr << paths[i] << ": " << strerror(errno) << "\n";
+      return 1;
+    }
+
+    syms.clear();
+    std::string error;
+    if (!for_each_coff_symbol(
+            file.data(), [&](String s) { syms.push_back(s); }, error)) {
+      std::cerr << paths[i] << ": " << error << "\n";
+      return 1;
+    }
+    if (config.lazy)
+      write_lazy(syms, out);
+    else
+      demangle_and_write(syms, out);
+  }
+  return 0;
+}
+
+static void print_stats() {
+  if (config.cache) {
+    ResultCache::Stats s = config.cache->stats();
+    fprintf(stderr,
+            "cache: %zu hits, %zu misses, %zu evictions, %zu entries, "
+            "%zu bytes\n",
+            s.hits, s.misses, s.evictions, s.entries, s.bytes);
+  }
+  if (config.name_cache_size) {
+    NameCache::Stats s = batch->name_cache_stats();
+    fprintf(stderr,
+            "name cache: %zu hits, %zu misses, %zu entries, %zu bytes, "
+            "%zu flushes\n",
+            s.hits, s.misses, s.entries, s.bytes, s.flushes);
+  }
+
+  if (config.pool) {
+    const StringPool::Stats &s = config.pool->stats();
+    fprintf(stderr,
+            "pool: %zu strings, %zu bytes, %zu records, %zu record bytes, "
+            "%zu bytes of memory\n",
+            s.strings, s.string_bytes, s.records, s.record_bytes,
+            s.memory());
+  }
+
+  if (config.lazy) {
+    fprintf(stderr,
+            "lazy: %zu symbols, %zu demangled, %zu failed, "
+            "%zu bytes of pool memory\n",
+            config.lazy_symbols, config.lazy_demangled, config.lazy_failed,
+            config.lazy_memory);
+  }
+
+  // One line per rule, in the same order for any input, so that
+  // outputs for different inputs can be compared with diff.
+  if (Demangler::trace_enabled) {
+    Demangler::Trace t = batch->demangler_trace();
+    double n = std::max<uint64_t>(t.symbols, 1);
+    for (int i = 0; i < NumTraceRules; ++i) {
+      const Demangler::Trace::Rule &r = t.rules[i];
+      double calls = std::max<uint64_t>(r.calls, 1);
+      fprintf(stderr,
+              "trace: %-17s %8.2f calls/symbol %8.1f ns/call "
+              "%8.1f ns self/call\n",
+              Demangler::Trace::rule_name((TraceRule)i), r.calls / n,
+              r.total_ns / calls, r.self_ns / calls);
+    }
+  }
+
+  if (!Demangler::stats_enabled) {
+    fprintf(stderr, "demangler: not compiled with DEMANGLE_STATS\n");
+    return;
+  }
+  Demangler::Stats s = batch->demangler_stats();
+  double n = std::max<size_t>(s.symbols, 1);
+  fprintf(stderr, "demangler: %zu symbols, %.1f ns parse, %.1f ns render "
+          "per symbol\n", s.symbols, s.parse_ns / n, s.render_ns / n);
+  fprintf(stderr, "arena: %zu bytes (%.1f per symbol), %zu chunks\n",
+          s.arena_bytes, s.arena_bytes / n, s.arena_chunks);
+  fprintf(stderr, "nodes: %zu names, %zu types\n", s.name_nodes,
+          s.type_nodes);
+  fprintf(stderr, "backrefs: %zu names, %zu params\n", s.name_backrefs,
+          s.param_backrefs);
+  fprintf(stderr, "max depth: %zu parse, %zu write\n", s.max_parse_depth,
+          s.max_write_depth);
+  if (s.symbols)
+    fprintf(stderr, "slowest: %s (%llu ns)\n", s.slowest.c_str(),
+            (unsigned long long)s.slowest_ns);
+}
+
+// Parses a size such as "512k" or "64m".
+static size_t parse_size(const char *s) {
+  char *end;
+  size_t n = strtoull(s, &end, 10);
+  switch (*end) {
+  case 'k': case 'K': return n << 10;
+  case 'm': case 'M': return n << 20;
+  case 'g': case 'G': return n << 30;
+  default: return n;
+  }
+}
+
+static void usage(const char *argv0) {
+  std::cout << "Usage: " << argv0 << " [options] [<symbol>]\n"
+            << "       " << argv0 << " [options] --coff <file>...\n"
+            << "\n"
+            << "If no symbol is given, symbols are read from stdin, "
+            << "one per line.\n"
+            << "\n"
+            << "Options:\n"
+            << "  -f <file>       Read symbols from a file, one per line\n"
+            << "  -j <n>          Use n threads to demangle symbols\n"
+            << "  --coff          Demangle symbols in .obj, .lib, .exe or "
+            << ".dll files\n"
+            << "  --cache <size>  Cache up to <size> bytes of results "
+            << "(k, m and g suffixes are allowed)\n"
+            << "  --name-cache <size>\n"
+            << "                  Cache up to <size> bytes of rendered "
+            << "template names per thread\n"
+            << "  --max-depth <n> Fail on symbols nested deeper than n "
+            << "(default 256)\n"
+            << "  --max-nodes <n> Fail on symbols with more than n nodes "
+            << "(default 65536)\n"
+            << "  --max-output <size>\n"
+            << "                  Fail on results longer than <size> bytes "
+            << "(default 1m)\n"
+            << "  --name-only     Print only qualified names of symbols\n"
+            << "  --no-return-type\n"
+            << "                  Omit return types of functions\n"
+            << "  --no-params     Omit parameter lists of functions\n"
+            << "  --no-template-args\n"
+            << "                  Omit template arguments\n"
+            << "  --no-qualifiers Omit \"const\" of member functions\n"
+            << "  --lazy          Demangle names on demand with a SymbolTable\n"
+            << "  --pool          Keep results in a StringPool and print "
+            << "them at the end\n"
+            << "  --sorted        Speed up sorted input by reusing names "
+            << "of previous symbols\n"
+            << "  --stats         Print statistics to stderr at exit\n"
+            << "  --validate      Print kinds of symbols instead of "
+            << "demangling them\n"
+            << "  --filter        Copy text, demangling symbols in it, "
+            << "like c++filt\n"
+            << "  --build-index <file>\n"
+            << "                  Write an index of demangled names of "
+            << "symbols to <file>\n"
+            << "  --lookup <file> Print symbols in an index whose "
+            << "demangled names are <symbol>\n"
+            << "  --lookup-prefix <file>\n"
+            << "                  Print symbols in an index whose "
+            << "demangled names start with <symbol>\n"
+            << "  --tokens        Print tokens of a demangled name, one "
+            << "per line\n";
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  const char *path = nullptr;
+  const char *build_index = nullptr;
+  const char *index = nullptr;
+  bool prefix = false;
+  bool pool = false;
+  size_t cache_size = 0;
+  bool coff = false;
+
+  int i = 1;
+  for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; ++i) {
+    if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+      path = argv[++i];
+    else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+      config.threads = std::max(1, atoi(argv[++i]));
+    else if (strcmp(argv[i], "--coff") == 0)
+      coff = true;
+    else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+      cache_size = parse_size(argv[++i]);
+    else if (strcmp(argv[i], "--name-cache") == 0 && i + 1 < argc)
+      config.name_cache_size = parse_size(argv[++i]);
+    else if (strcmp(argv[i], "--max-depth") == 0 && i + 1 < argc)
+      config.limits.max_depth = parse_size(argv[++i]);
+    else if (strcmp(argv[i], "--max-nodes") == 0 && i + 1 < argc)
+      config.limits.max_nodes = parse_size(argv[++i]);
+    else if (strcmp(argv[i], "--max-output") == 0 && i + 1 < argc)
+      config.limits.max_output = parse_size(argv[++i]);
+    else if (strcmp(argv[i], "--name-only") == 0)
+      config.flags |= NameOnly;
+    else if (strcmp(argv[i], "--no-return-type") == 0)
+      config.flags |= NoReturnType;
+    else if (strcmp(argv[i], "--no-params") == 0)
+      config.flags |= NoParams;
+    else if (strcmp(argv[i], "--no-template-args") == 0)
+      config.flags |= NoTemplateArgs;
+    else if (strcmp(argv[i], "--no-qualifiers") == 0)
+      config.flags |= NoQualifiers;
+    else if (strcmp(argv[i], "--lazy") == 0)
+      config.lazy = true;
+    else if (strcmp(argv[i], "--pool") == 0)
+      pool = true;
+    else if (strcmp(argv[i], "--sorted") == 0)
+      config.incremental = true;
+    else if (strcmp(argv[i], "--stats") == 0)
+      config.stats = true;
+    else if (strcmp(argv[i], "--validate") == 0)
+      config.validate = true;
+    else if (strcmp(argv[i], "--tokens") == 0)
+      config.tokens = true;
+    else if (strcmp(argv[i], "--filter") == 0)
+      config.filter = true;
+    else if (strcmp(argv[i], "--build-index") == 0 && i + 1 < argc)
+      build_index = argv[++i];
+    else if (strcmp(argv[i], "--lookup") == 0 && i + 1 < argc)
+      index = argv[++i];
+    else if (strcmp(argv[i], "--lookup-prefix") == 0 && i + 1 < argc)
+      index = argv[++i], prefix = true;
+    else
+      usage(argv[0]);
+  }
+
+  // Use more shards than threads so that threads rarely contend.
+  if (cache_size)
+    config.cache.reset(new ResultCache(cache_size, config.threads * 4));
+
+  BatchDemangler::Options opts;
+  opts.threads = config.threads;
+  opts.cache = config.cache.get();
+  opts.name_cache_size = config.name_cache_size;
+  opts.limits = config.limits;
+  opts.flags = config.flags;
+  opts.incremental = config.incremental;
+  batch.reset(new BatchDemangler(opts));
+
+  if (index) {
+    if (i + 1 != argc || path || coff || build_index)
+      usage(argv[0]);
+    return lookup(index, argv[i], prefix);
+  }
+
+  if (coff) {
+    if (i == argc || path || config.validate || config.tokens ||
+        config.filter || build_index)
+      usage(argv[0]);
+    int ret = demangle_coff(argv + i, argc - i);
+    if (config.stats)
+      print_stats();
+    return ret;
+  }
+
+  // Read symbols from a file or stdin.
+  if (i == argc || (i + 1 == argc && strcmp(argv[i], "-") == 0)) {
+    if (config.tokens)
+      usage(argv[0]);
+    FILE *in = stdin;
+    if (path && !(in = fopen(path, "rb"))) {
+      std::cerr << path << ": cannot open\n";
+      return 1;
+    }
+    if (config.validate) {
+      validate_stream(in);
+      return 0;
+    }
+    if (build_index) {
+      std::string buf;
+      std::vector<String> syms = read_lines(in, buf);
+      if (!write_index(*batch, syms, build_index)) {
+        std::cerr << build_index << ": " << strerror(errno) << "\n";
+        return 1;
+      }
+      return 0;
+    }
+    if (config.filter) {
+      Demangler demangler;
+      demangler.set_limits(config.limits);
+      demangler.set_flags(config.flags);
+      TextFilter(demangler).run(in, stdout);
+      return 0;
+    }
+    if (config.lazy) {
+      std::string buf, out;
+      write_lazy(read_lines(in, buf), out);
+    } else if (pool) {
+      StringPool::Options opts;
+      opts.dedup = opts.share_prefixes = true;
+      config.pool.reset(new StringPool(opts));
+      pool_stream(in);
+    } else {
+      demangle_stream(in);
+    }
+    if (config.stats)
+      print_stats();
+    return 0;
+  }
+
+  if (i + 1 != argc || path || config.filter || build_index)
+    usage(argv[0]);
+
+  Demangler demangler(String(argv[i], strlen(argv[i])));
+  demangler.set_limits(config.limits);
+  demangler.set_flags(config.flags);
+
+  if (config.validate) {
+    Demangler::SymbolInfo info;
+    if (!demangler.validate({argv[i], strlen(argv[i])}, info)) {
+      std::cerr << demangler.error_message() << "\n";
+      return 1;
+    }
+    std::cout << describe(info) << '\n';
+    return 0;
+  }
+
+  demangler.parse();
+  std::string result;
+  if (!demangler.error) {
+    if (config.tokens) {
+      TokenPrinter printer;
+      demangler.write(printer);
+      result = printer.out;
+    } else {
+      result = demangler.str() + "\n";
+    }
+  }
+  if (demangler.error) {
+    std::cerr << demangler.error_message() << "\n";
+    return 1;
+  }
+
+  std::cout << result;
+  return 0;
+}